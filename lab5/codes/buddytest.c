@@ -0,0 +1,15 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Reports the buddy allocator self-test the kernel ran at boot,
+// with the free-block distribution now.
+int main(int argc, char *argv[])
+{
+  int r;
+
+  buddystat();
+  r = buddytest();
+  printf(1, "buddy test at boot %s\n", r == 0 ? "passed" : "FAILED");
+  exit();
+}
@@ -0,0 +1,107 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "kalloc.h"
+
+// Read one word per page, all at the same offset, over an array
+// of a few hundred KB, first with page colouring off and then on.
+// Every word then falls in the same L2 set of its colour, so
+// with random physical pages some colours get more pages than
+// the cache has ways and keep evicting each other; with
+// colouring the pages are spread evenly across the colours.
+//
+// colortest [pages [rounds]]; the default of 8 pages per colour
+// fits an 8-way L2 exactly when the colours are even.
+
+#define PGSIZE 4096
+#define NTRIAL 5
+
+struct kallocstat ks[NCPU];
+
+void colorstat(uint *hits, uint *misses)
+{
+  int i;
+
+  kallocstat(ks);
+  *hits = *misses = 0;
+  for (i = 0; i < NCPU; i++)
+  {
+    *hits += ks[i].colorhits;
+    *misses += ks[i].colormisses;
+  }
+}
+
+// Cycles for rounds passes over npages fresh pages.
+uint trial(int npages, int rounds)
+{
+  volatile int *a;
+  uint64 t0, t1;
+  int i, r, sum;
+
+  a = (int *)sbrk(npages * PGSIZE);
+  if (a == (int *)-1)
+  {
+    printf(1, "colortest: sbrk failed\n");
+    exit();
+  }
+  for (i = 0; i < npages; i++)
+    a[i * (PGSIZE / 4)] = i;
+
+  sum = 0;
+  t0 = rdtsc();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < npages; i++)
+      sum += a[i * (PGSIZE / 4)];
+  t1 = rdtsc();
+
+  if (sum != rounds * (npages * (npages - 1) / 2))
+    printf(1, "colortest: bad sum\n");
+  sbrk(-npages * PGSIZE);
+  return (uint)(t1 - t0);
+}
+
+void run(int on, int npages, int rounds)
+{
+  uint c, total, worst, n, h0, m0, h1, m1;
+  int t;
+
+  setcolor(on);
+  colorstat(&h0, &m0);
+  total = worst = 0;
+  for (t = 0; t < NTRIAL; t++)
+  {
+    c = trial(npages, rounds);
+    total += c / NTRIAL;
+    if (c > worst)
+      worst = c;
+  }
+  colorstat(&h1, &m1);
+
+  n = npages * rounds;
+  printf(1, "colouring %s: %d.%d cycles/access on average, %d.%d at worst",
+         on ? "on " : "off", total / n, (total % n) * 10 / n,
+         worst / n, (worst % n) * 10 / n);
+  printf(1, " (%d pages coloured, %d not)\n", h1 - h0, m1 - m0);
+}
+
+int main(int argc, char *argv[])
+{
+  int npages, rounds, old;
+
+  npages = NCOLOR * 8;
+  rounds = 2000;
+  if (argc > 1)
+    npages = atoi(argv[1]);
+  if (argc > 2)
+    rounds = atoi(argv[2]);
+
+  printf(1, "%d pages over %d colours, %d rounds, %d trials each\n",
+         npages, NCOLOR, rounds, NTRIAL);
+  old = setcolor(0);
+  run(0, npages, rounds);
+  run(1, npages, rounds);
+  setcolor(old);
+  exit();
+}
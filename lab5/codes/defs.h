@@ -1,14 +1,27 @@
 struct buf;
 struct context;
 struct file;
+struct frame;
 struct inode;
+struct kallocstat;
+struct lockcount;
+struct lockstat;
+struct ksmstat;
+struct memstat;
+struct zramstat;
+struct kmem_cache;
+struct pi;
 struct pipe;
 struct proc;
+struct rcu_head;
 struct rtcdate;
+struct seqlock;
+struct shm;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct trapframe;
 
 // bio.c
 void            binit(void);
@@ -34,6 +47,31 @@ int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
+// frame.c
+void            frameinit(void);
+void            frame_newpgdir(pde_t*);
+void            frame_setpid(pde_t*, int);
+void            frame_insert(pde_t*, uint, uint, int);
+void            frame_remove(pde_t*, uint);
+void            frame_evict(struct frame*, int);
+uint            frame_freeall(pde_t*);
+struct frame*   frame_lookup(pde_t*, uint);
+void            frame_cold(pde_t*, uint);
+void            frame_access(struct frame*);
+void            frame_sample(void);
+struct frame*   frame_victim(int (*)(struct frame*));
+int             frame_setpolicy(int);
+void            frame_toshared(struct frame*);
+void            frame_addshared(pde_t*);
+void            frame_ksmscan(int (*)(struct frame*));
+uint            frame_count(pde_t*);
+uint            frame_nswapped(pde_t*);
+uint            frame_nsuper(pde_t*);
+void            frame_super(pde_t*, int);
+void            frame_unswap(pde_t*);
+uint            frame_wss(pde_t*, uint);
+void            framedump(void);
+
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
@@ -53,6 +91,10 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futex(uint, int, uint);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -65,9 +107,32 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_order(int);
+char*           kalloc_super(void);
+char*           kalloc_zeroed(void);
+char*           kalloc_color(int);
+char*           kalloc_color_zeroed(int);
+int             kalloc_setcolor(int);
+int             kzero_idle(void);
 void            kfree(char*);
+void            kfree_order(char*, int);
+void            kfree_super(char*);
+void            kallocdump(void);
+int             buddy_test(void);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kallocstat(struct kallocstat*);
+
+// ksm.c
+void            ksminit(void);
+void            ksm_scan(int (*)(struct frame*));
+int             ksm_due(void);
+int             ksm_dup(pde_t*, uint);
+void            ksm_put(uint);
+int             ksm_unshare(struct proc*, uint);
+int             ksmfault(struct trapframe*);
+void            ksm_stat(struct ksmstat*);
+void            ksmdump(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -95,9 +160,17 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pi.c
+void            piinit(void);
+void            pi_init(struct pi*);
+void            pi_block(struct pi*);
+void            pi_handoff(struct pi*, struct proc*);
+void            pi_setprio(struct proc*, int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+void            pipeinit(void);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
@@ -110,16 +183,43 @@ int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+struct proc*    findproc(int);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             swapout(void);
+int             ksmscan(void);
+void            memsample(void);
+void            memtick(void);
+int             procmemstat(struct memstat*, int);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+int             rcubench(int, uint, uint);
+
+// rcu.c
+void            rcuinit(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            call_rcu(struct rcu_head*, void (*)(struct rcu_head*));
+void            synchronize_rcu(void);
+uint            rcu_poll_start(void);
+int             rcu_poll_done(uint);
+void            rcu_quiescent(void);
+
+// repl.c
+void            replinit(void);
+int             repl_setpolicy(int);
+void            repl_insert(struct frame*, int);
+void            repl_access(struct frame*);
+void            repl_remove(struct frame*, int, int);
+void            repl_cold(struct frame*);
+struct frame*   repl_victim(int (*)(struct frame*));
+void            repldump(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -129,10 +229,40 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlock_type(struct spinlock*, char*, int);
+int             lockbench(int, uint, uint);
+int             lockprof(int);
+int             lockprof_stat(struct lockstat*, int);
+int             lockprof_percpu(struct spinlock*, struct lockcount*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// shm.c
+void            shminit(void);
+int             shm_alloc(struct proc*, int);
+int             shm_dup(struct proc*, struct shm*);
+void            shm_put(struct shm*);
+int             shm_has(struct proc*, uint);
+
+// slab.c
+void            slabinit(void);
+void            kmem_cache_init(struct kmem_cache*, char*, uint, void(*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void*           kmalloc(uint);
+void            kmfree(void*);
+void            slabdump(void);
+
+// seqlock.c
+void            initseqlock(struct seqlock*, char*);
+uint            read_seqbegin(struct seqlock*);
+int             read_seqretry(struct seqlock*, uint);
+void            write_seqbegin(struct seqlock*);
+void            write_seqend(struct seqlock*);
+void            write_seqlock(struct seqlock*);
+void            write_sequnlock(struct seqlock*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -152,6 +282,19 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int);
+char*           swapalloc(int, int);
+int             swapmark(struct proc*, struct frame*, int*);
+int             swapwrite(int, char*);
+int             swapread(pte_t, char*);
+int             swapin(struct proc*, uint);
+int             swapfault(struct trapframe*);
+void            swapfree(pte_t);
+void            swapdrop(struct frame*);
+void            swappin(uint, uint);
+void            swapdump(void);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
@@ -178,10 +321,14 @@ void            uartputc(int);
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
+pte_t*          walkpgdir(pde_t*, const void*, int);
 char*           uva2ka(pde_t*, char*);
+int             mappages(pde_t*, void*, uint, uint, int);
+uint            uvmpa(pde_t*, uint);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
+int             uvmsplit(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
@@ -189,11 +336,27 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             lazyin(struct proc*, uint);
+void            uvmtouch(struct proc*, uint);
+int             lazyfault(struct trapframe*);
+void            seqfault(struct proc*, uint);
+int             uvmadvise(struct proc*, uint, uint, int);
+int             uvmcolor(pde_t*, uint);
 int             show_process_family(int);
 void            balance_load(void);
 int             start_throughput_measuring(void);
 int             end_throughput_measuring(void);
 void            print_process_info(void);
+int             handle_paging_request(char*, int, int);
+void            print_paging_stats(void);
+
+// zram.c
+void            zraminit(uint);
+int             zram_store(uint, char*);
+int             zram_load(uint, char*);
+void            zram_drop(uint);
+void            zram_stat(struct zramstat*);
+void            zramdump(void);
 
 
 
@@ -203,9 +366,12 @@ void            print_process_info(void);
 
 
 struct plock;
+struct plockstat;
 void            plock_init(struct plock*, char*);
 void            plock_acquire(struct plock*, int);
-void            plock_release(struct plock*);
+int             plock_release(struct plock*);
+void            plock_exit(struct proc*);
+void            plock_stat(struct plock*, struct plockstat*, int);
 
 
  
@@ -216,6 +382,11 @@ void rwlock_acquire_read(struct rwlock*);
 void rwlock_release_read(struct rwlock*);
 void rwlock_acquire_write(struct rwlock*);
 void rwlock_release_write(struct rwlock*);
+int rwlock_tryread(struct rwlock*);
+int rwlock_trywrite(struct rwlock*);
+int rwlock_acquire_read_timeout(struct rwlock*, int);
+int rwlock_acquire_write_timeout(struct rwlock*, int);
+int rwbench(int, uint, uint);
 int sys_rwlock_test(void);
 
 
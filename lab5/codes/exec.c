@@ -96,11 +96,15 @@ exec(char *path, char **argv)
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
+  frame_setpid(pgdir, curproc->pid);
   curproc->sz = sz;
+  memset(curproc->seq, 0, sizeof(curproc->seq));
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
   freevm(oldpgdir);
+  shm_put(curproc->shm);
+  curproc->shm = 0;
   return 0;
 
  bad:
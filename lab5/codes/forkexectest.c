@@ -0,0 +1,58 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// Times fork+exit+wait and fork+exec+wait.  Both paths build a
+// fresh page directory with setupkvm() and tear one down with
+// freevm(), so they track what per-process page tables cost.
+
+#define N 200
+
+int main(int argc, char *argv[])
+{
+  char *args[] = {"forkexectest", "child", 0};
+  uint64 t0, t1;
+  int i, pid;
+
+  if (argc > 1)
+    exit();
+
+  t0 = rdtsc();
+  for (i = 0; i < N; i++)
+  {
+    pid = fork();
+    if (pid < 0)
+    {
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if (pid == 0)
+      exit();
+    wait();
+  }
+  t1 = rdtsc();
+  printf(1, "fork+wait: %d cycles\n", (uint)((t1 - t0) >> 3) / (N >> 3));
+
+  t0 = rdtsc();
+  for (i = 0; i < N; i++)
+  {
+    pid = fork();
+    if (pid < 0)
+    {
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if (pid == 0)
+    {
+      exec(args[0], args);
+      printf(1, "exec failed\n");
+      exit();
+    }
+    wait();
+  }
+  t1 = rdtsc();
+  printf(1, "fork+exec+wait: %d cycles\n", (uint)((t1 - t0) >> 3) / (N >> 3));
+
+  exit();
+}
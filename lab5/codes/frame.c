@@ -0,0 +1,412 @@
+// The frame table, an inverted page table.
+//
+// frames[] has one entry per physical page below PHYSTOP.  For
+// a user page it records the address space (page directory) and
+// virtual page that map it, the owner's pid, how many PTEs share
+// it, and the replacement policy's bookkeeping.  vm.c and swap.c
+// keep it current as pages are mapped and unmapped.
+//
+// A hash on (pgdir, vpn) finds the frame behind a user address
+// without walking the page table.  The pid is not part of the
+// key because fork and exec fill an address space in before it
+// has one.  The user pages of each address space are also linked
+// from the frame of its page directory, so freevm() takes time
+// in proportion to what the process owns.
+//
+// Once a tick, from the scheduler loop, frame_sample() reads and
+// clears the PTE_A bits of a batch of frames and tells the policy
+// which pages were referenced.  When the CPUs are idle, ksm.c
+// looks through frames for identical pages to merge, also with
+// the table locked.
+//
+// A 4MB superpage that allocuvm() maps stays out of the table,
+// only counted in its page directory's frame, until the pager
+// splits it (see uvmsplit()).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "frame.h"
+
+#define NSAMPLE 1024  // frames frame_sample() looks at per tick
+#define NFHASH  4096  // hash buckets, a power of two
+
+struct frame *frames;
+
+struct {
+  struct spinlock lock;
+  struct frame *hash[NFHASH];
+  uint hand;              // next frame frame_sample() looks at
+  uint nuser;             // user pages in the table
+} frametab;
+
+static uint
+fhash(pde_t *pgdir, uint vpn)
+{
+  return ((V2P(pgdir) >> PTXSHIFT) * 31 + vpn) & (NFHASH-1);
+}
+
+// The frame heading pgdir's list of pages.
+static struct frame*
+anchor(pde_t *pgdir)
+{
+  return PA2FRAME(V2P(pgdir));
+}
+
+// Allocate the table; it is sized from PHYSTOP, so it comes
+// from the page allocator rather than the kernel's bss.
+void
+frameinit(void)
+{
+  uint sz, a;
+  int order;
+  char *mem;
+
+  initlock(&frametab.lock, "frametab");
+  sz = PGROUNDUP(NFRAME * sizeof(struct frame));
+  for(order = 0; (PGSIZE << order) < sz; order++)
+    ;
+  if((mem = kalloc_order(order)) == 0)
+    panic("frameinit");
+  // Give back what the power-of-two block has beyond sz.
+  for(a = sz; a < (PGSIZE << order); a += PGSIZE)
+    kfree(mem + a);
+  memset(mem, 0, sz);
+  frames = (struct frame*)mem;
+  replinit();
+  ksminit();
+}
+
+// A new page directory: clear the list its frame heads.
+void
+frame_newpgdir(pde_t *pgdir)
+{
+  struct frame *a = anchor(pgdir);
+
+  acquire(&frametab.lock);
+  a->pages = 0;
+  a->npages = 0;
+  a->nswapped = 0;
+  a->nshared = 0;
+  a->nsuper = 0;
+  a->pid = 0;
+  release(&frametab.lock);
+}
+
+// The process with pid now owns pgdir's pages.
+void
+frame_setpid(pde_t *pgdir, int pid)
+{
+  struct frame *a = anchor(pgdir), *f;
+
+  acquire(&frametab.lock);
+  a->pid = pid;
+  for(f = a->pages; f; f = f->onext)
+    f->pid = pid;
+  release(&frametab.lock);
+}
+
+// Start tracking the user page at pa, mapped at va in pgdir.
+// refault is 1 if it has just been read back from swap.
+void
+frame_insert(pde_t *pgdir, uint va, uint pa, int refault)
+{
+  struct frame *f = PA2FRAME(pa), *a = anchor(pgdir);
+  uint h;
+
+  acquire(&frametab.lock);
+  if(f->pgdir)
+    panic("frame_insert");
+  f->pgdir = pgdir;
+  f->vpn = va >> PTXSHIFT;
+  f->pid = a->pid;
+  f->refcnt = 1;
+  f->csum = 0;
+  h = fhash(pgdir, f->vpn);
+  f->hnext = frametab.hash[h];
+  frametab.hash[h] = f;
+  f->oprev = 0;
+  f->onext = a->pages;
+  if(a->pages)
+    a->pages->oprev = f;
+  a->pages = f;
+  a->npages++;
+  if(refault && a->nswapped > 0)
+    a->nswapped--;
+  frametab.nuser++;
+  repl_insert(f, refault);
+  release(&frametab.lock);
+}
+
+// Take f out of the hash and its owner's list.
+// Caller holds frametab.lock.
+static void
+unlink(struct frame *f)
+{
+  struct frame **pp, *a = anchor(f->pgdir);
+
+  for(pp = &frametab.hash[fhash(f->pgdir, f->vpn)]; *pp != f; pp = &(*pp)->hnext)
+    ;
+  *pp = f->hnext;
+  if(f->oprev)
+    f->oprev->onext = f->onext;
+  else
+    a->pages = f->onext;
+  if(f->onext)
+    f->onext->oprev = f->oprev;
+  a->npages--;
+  frametab.nuser--;
+  f->pgdir = 0;
+  f->hnext = f->onext = f->oprev = 0;
+  f->pid = 0;
+  f->refcnt = 0;
+}
+
+// pgdir is about to unmap and free the page at pa.
+void
+frame_remove(pde_t *pgdir, uint pa)
+{
+  struct frame *f = PA2FRAME(pa);
+
+  acquire(&frametab.lock);
+  if(f->pgdir == pgdir){
+    repl_remove(f, 0, 0);
+    unlink(f);
+  }
+  release(&frametab.lock);
+  swapdrop(f);
+}
+
+// f has been chosen and unmapped by swapout(); write is set
+// if its contents had to go to disk.
+void
+frame_evict(struct frame *f, int write)
+{
+  acquire(&frametab.lock);
+  anchor(f->pgdir)->nswapped++;
+  repl_remove(f, 1, write);
+  unlink(f);
+  release(&frametab.lock);
+}
+
+// ksm.c has pointed f's PTE at a merged page, so f is no longer
+// a page of its own.  Caller holds frametab.lock.
+void
+frame_toshared(struct frame *f)
+{
+  anchor(f->pgdir)->nshared++;
+  repl_remove(f, 0, 0);
+  unlink(f);
+  swapdrop(f);
+}
+
+// pgdir has been given a PTE to a merged page by copyuvm().
+void
+frame_addshared(pde_t *pgdir)
+{
+  acquire(&frametab.lock);
+  anchor(pgdir)->nshared++;
+  release(&frametab.lock);
+}
+
+// Free every user page of pgdir, which is being destroyed.
+// Returns the number of PTEs it may still have to pages in swap
+// or to merged pages, which freevm() has to look for.  It is
+// never too low: nshared is not decremented when a page is
+// unshared, so freevm() may scan further than it needs to.
+uint
+frame_freeall(pde_t *pgdir)
+{
+  struct frame *a = anchor(pgdir), *f;
+  uint nleft;
+
+  acquire(&frametab.lock);
+  while((f = a->pages) != 0){
+    repl_remove(f, 0, 0);
+    unlink(f);
+    swapdrop(f);
+    kfree(P2V(FRAME2PA(f)));
+  }
+  nleft = a->nswapped + a->nshared;
+  a->nswapped = 0;
+  a->nshared = 0;
+  a->nsuper = 0;
+  release(&frametab.lock);
+  return nleft;
+}
+
+// The frame mapped at va in pgdir, or 0 if none is resident.
+struct frame*
+frame_lookup(pde_t *pgdir, uint va)
+{
+  struct frame *f;
+  uint vpn = va >> PTXSHIFT;
+
+  acquire(&frametab.lock);
+  for(f = frametab.hash[fhash(pgdir, vpn)]; f; f = f->hnext)
+    if(f->pgdir == pgdir && f->vpn == vpn)
+      break;
+  release(&frametab.lock);
+  return f;
+}
+
+// madvise(MADV_SEQUENTIAL) says the page at va in pgdir is done
+// with: have the policy evict it next.
+void
+frame_cold(pde_t *pgdir, uint va)
+{
+  struct frame *f;
+  uint vpn = va >> PTXSHIFT;
+
+  acquire(&frametab.lock);
+  for(f = frametab.hash[fhash(pgdir, vpn)]; f; f = f->hnext)
+    if(f->pgdir == pgdir && f->vpn == vpn){
+      repl_cold(f);
+      break;
+    }
+  release(&frametab.lock);
+}
+
+// The kernel itself referenced the user page behind f.
+void
+frame_access(struct frame *f)
+{
+  acquire(&frametab.lock);
+  if(f->pgdir)
+    repl_access(f);
+  release(&frametab.lock);
+}
+
+// Called by memtick() once a tick: collect the PTE_A bits of the
+// next NSAMPLE frames.  The bit is cleared with a locked
+// instruction because another CPU may be setting PTE_D in the
+// same entry.  A CPU running the page's process may keep using
+// a TLB entry that already has PTE_A set, so its later
+// references go unseen until its next switch; that only makes
+// the page look a little colder than it is.
+void
+frame_sample(void)
+{
+  struct frame *f;
+  pte_t *pte;
+  int i;
+
+  acquire(&frametab.lock);
+  for(i = 0; i < NSAMPLE; i++){
+    f = &frames[frametab.hand];
+    frametab.hand = (frametab.hand + 1) % NFRAME;
+    if(f->pgdir == 0)
+      continue;
+    pte = walkpgdir(f->pgdir, (char*)FRAMEVA(f), 0);
+    if(pte && (*pte & PTE_A)){
+      __sync_fetch_and_and(pte, ~PTE_A);
+      repl_access(f);
+    }
+  }
+  release(&frametab.lock);
+}
+
+// Ask the policy for a page to evict, among those ok() accepts.
+struct frame*
+frame_victim(int (*ok)(struct frame*))
+{
+  struct frame *f;
+
+  acquire(&frametab.lock);
+  f = repl_victim(ok);
+  release(&frametab.lock);
+  return f;
+}
+
+int
+frame_setpolicy(int n)
+{
+  int old;
+
+  acquire(&frametab.lock);
+  old = repl_setpolicy(n);
+  release(&frametab.lock);
+  return old;
+}
+
+// Let ksm.c look at the next batch of frames for pages to merge,
+// among those ok() accepts.
+void
+frame_ksmscan(int (*ok)(struct frame*))
+{
+  acquire(&frametab.lock);
+  ksm_scan(ok);
+  release(&frametab.lock);
+}
+
+// Number of resident user pages in pgdir, superpages included.
+uint
+frame_count(pde_t *pgdir)
+{
+  struct frame *a = anchor(pgdir);
+
+  return a->npages + a->nsuper * NPTENTRIES;
+}
+
+// pgdir has gained (n > 0) or lost (n < 0) superpages.
+void
+frame_super(pde_t *pgdir, int n)
+{
+  acquire(&frametab.lock);
+  anchor(pgdir)->nsuper += n;
+  release(&frametab.lock);
+}
+
+// Number of superpages pgdir maps.
+uint
+frame_nsuper(pde_t *pgdir)
+{
+  return anchor(pgdir)->nsuper;
+}
+
+// Number of pages pgdir has in swap.
+uint
+frame_nswapped(pde_t *pgdir)
+{
+  return anchor(pgdir)->nswapped;
+}
+
+// deallocuvm() has freed one of pgdir's pages in swap.
+void
+frame_unswap(pde_t *pgdir)
+{
+  acquire(&frametab.lock);
+  anchor(pgdir)->nswapped--;
+  release(&frametab.lock);
+}
+
+// Resident pages of pgdir that frame_sample() has seen
+// referenced in the last window ticks.  frame_sample() cannot
+// see into a superpage, so each one counts in full.
+uint
+frame_wss(pde_t *pgdir, uint window)
+{
+  struct frame *f;
+  uint n;
+
+  acquire(&frametab.lock);
+  n = anchor(pgdir)->nsuper * NPTENTRIES;
+  for(f = anchor(pgdir)->pages; f; f = f->onext)
+    if(ticks - f->last < window)
+      n++;
+  release(&frametab.lock);
+  return n;
+}
+
+void
+framedump(void)
+{
+  acquire(&frametab.lock);
+  cprintf("frames: %d user pages of %d\n", frametab.nuser, NFRAME);
+  repldump();
+  release(&frametab.lock);
+}
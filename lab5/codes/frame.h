@@ -0,0 +1,39 @@
+// The frame table: an inverted page table with one struct
+// frame per physical page, telling which address space maps a
+// user page and where, for eviction and sharing decisions.
+// A page merged by ksm.c is mapped by several address spaces;
+// its frame has pgdir 0 and refcnt counting the PTEs.
+
+struct frame {
+  pde_t *pgdir;        // Address space mapping this page, 0 if not a user page
+  uint vpn;            // Virtual page number it is mapped at
+  int pid;             // Owner's pid, 0 while fork or exec build it
+  ushort refcnt;       // PTEs mapping the page
+  uchar q;             // Which replacement policy list holds it, 0 if none
+  uchar ref;           // Clock reference bit
+  uint swapslot;       // 1 + swap slot still holding a clean copy, or 0
+  struct frame *hnext; // Next in (pgdir, vpn) hash chain
+  struct frame *onext; // Pages of the same address space
+  struct frame *oprev;
+  struct frame *prev;  // Neighbours in the policy's list (prev is towards MRU)
+  struct frame *next;
+  uint last;           // Tick of last access seen
+  uint count;          // Accesses seen (LFU)
+  uint csum;           // Checksum of the contents ksm.c saw last
+
+  // Only used in the frame of a page directory:
+  struct frame *pages; // Its address space's user pages
+  uint npages;         // How many
+  uint nswapped;       // How many it has in swap
+  uint nshared;        // At least as many PTEs to merged pages
+  uint nsuper;         // 4MB superpages it maps, not in the table
+};
+
+#define NFRAME  (PHYSTOP/PGSIZE)
+
+extern struct frame *frames;
+
+// Frame of a physical address and back.
+#define PA2FRAME(pa)  (&frames[(uint)(pa) / PGSIZE])
+#define FRAME2PA(f)   ((uint)((f) - frames) * PGSIZE)
+#define FRAMEVA(f)    ((f)->vpn << PTXSHIFT)
@@ -14,9 +14,11 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "seqlock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -24,18 +26,24 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
 // there should be one superblock per disk device, but we run with
-// only one device
-struct superblock sb; 
+// only one device.  It is read once by iinit() and from then on
+// copied out under a seqlock, so file system code on every CPU
+// can look at it without sharing a lock.
+struct {
+  struct seqlock seq;
+  struct superblock sb;
+} super;
 
 // Read the super block.
 void
 readsb(int dev, struct superblock *sb)
 {
-  struct buf *bp;
+  uint s;
 
-  bp = bread(dev, 1);
-  memmove(sb, bp->data, sizeof(*sb));
-  brelse(bp);
+  do {
+    s = read_seqbegin(&super.seq);
+    *sb = super.sb;
+  } while(read_seqretry(&super.seq, s));
 }
 
 // Zero a block.
@@ -58,7 +66,9 @@ balloc(uint dev)
 {
   int b, bi, m;
   struct buf *bp;
+  struct superblock sb;
 
+  readsb(dev, &sb);
   bp = 0;
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
@@ -82,8 +92,10 @@ static void
 bfree(int dev, uint b)
 {
   struct buf *bp;
+  struct superblock sb;
   int bi, m;
 
+  readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
@@ -157,7 +169,12 @@ bfree(int dev, uint b)
 // The icache.lock spin-lock protects the allocation of icache
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock to change dev and inum or
+// to take ref to or from zero.  iget() finds an inode that is
+// in use without the lock, under RCU: an entry whose ref falls
+// to zero is not recycled for another inode until a grace
+// period later, so a reader that saw ref non-zero and then the
+// right dev and inum can add its reference atomically.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
@@ -172,12 +189,21 @@ void
 iinit(int dev)
 {
   int i = 0;
+  struct buf *bp;
+  struct superblock sb;
   
   initlock(&icache.lock, "icache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
   }
 
+  initseqlock(&super.seq, "superblock");
+  bp = bread(dev, 1);
+  write_seqlock(&super.seq);
+  memmove(&super.sb, bp->data, sizeof(super.sb));
+  write_sequnlock(&super.seq);
+  brelse(bp);
+
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
@@ -197,7 +223,9 @@ ialloc(uint dev, short type)
   int inum;
   struct buf *bp;
   struct dinode *dip;
+  struct superblock sb;
 
+  readsb(dev, &sb);
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
@@ -222,7 +250,9 @@ iupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
+  struct superblock sb;
 
+  readsb(ip->dev, &sb);
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
@@ -242,30 +272,61 @@ static struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  int r, wait;
+
+  // Is the inode already cached and in use?
+  rcu_read_lock();
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    while((r = *(volatile int*)&ip->ref) > 0 &&
+          *(volatile uint*)&ip->dev == dev &&
+          *(volatile uint*)&ip->inum == inum){
+      if(cmpxchg((uint*)&ip->ref, r, r + 1) == r){
+        rcu_read_unlock();
+        return ip;
+      }
+    }
+  }
+  rcu_read_unlock();
 
   acquire(&icache.lock);
 
-  // Is the inode already cached?
+retry:
+  // Did it get cached meanwhile?
   empty = 0;
+  wait = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+      xadd((uint*)&ip->ref, 1);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    if(empty == 0 && ip->ref == 0){    // Remember empty slot.
+      if(rcu_poll_done(ip->freegp))
+        empty = ip;
+      else
+        wait = 1;
+    }
   }
 
   // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  if(empty == 0){
+    if(!wait)
+      panic("iget: no inodes");
+    // Every free entry might still be in a reader's hands.
+    release(&icache.lock);
+    synchronize_rcu();
+    acquire(&icache.lock);
+    goto retry;
+  }
 
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->valid = 0;
+  // Readers check ref before dev and inum; x86 keeps these
+  // stores in order.
+  __asm__ volatile("" ::: "memory");
+  ip->ref = 1;
   release(&icache.lock);
 
   return ip;
@@ -276,9 +337,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  xadd((uint*)&ip->ref, 1);
   return ip;
 }
 
@@ -289,6 +348,7 @@ ilock(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
+  struct superblock sb;
 
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
@@ -296,6 +356,7 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
+    readsb(ip->dev, &sb);
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
@@ -347,7 +408,8 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(xadd((uint*)&ip->ref, -1) == 1)
+    ip->freegp = rcu_poll_start();
   release(&icache.lock);
 }
 
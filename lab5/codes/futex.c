@@ -0,0 +1,130 @@
+// Fast user-space locking.
+//
+// A user-space lock keeps its state in a word of user memory and
+// calls futex() only when it has to wait, or when it knows there
+// are waiters to wake.  Sleepers are keyed by the physical
+// address of the word, so processes mapping the same page (see
+// shm.c) meet in the same queue whatever address each sees it at.
+//
+// FUTEX_WAIT checks the word with the queue's lock held, and
+// FUTEX_WAKE takes that lock too, so a wake issued after the word
+// changes cannot slip in between the check and the sleep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "futex.h"
+
+#define NFUTEXQ 64
+
+// A sleeping process, on its own kernel stack.
+struct futexwait {
+  uint key;                 // physical address of the word
+  struct proc *proc;
+  int woken;
+  struct futexwait *next;
+};
+
+static struct futexq {
+  struct spinlock lock;
+  struct futexwait *head;   // oldest first
+} futexq[NFUTEXQ];
+
+void futexinit(void)
+{
+  int i;
+
+  for (i = 0; i < NFUTEXQ; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+static struct futexq *queue(uint key)
+{
+  return &futexq[((key >> 2) ^ (key >> 12)) % NFUTEXQ];
+}
+
+// Physical address of the word at va in p, the current process,
+// or 0 if there is none.  A private page is pinned for the rest of
+// the call; a shared one never leaves memory.
+static uint futexkey(struct proc *p, uint va)
+{
+  if (va % sizeof(uint))
+    return 0;
+  if (va < p->sz && p->sz - va >= sizeof(uint))
+    swappin(va, sizeof(uint));
+  else if (!shm_has(p, va))
+    return 0;
+  return uvmpa(p->pgdir, va);
+}
+
+static int futex_wait(struct futexq *q, uint key, uint val)
+{
+  struct futexwait w, **pp;
+  struct proc *p = myproc();
+
+  acquire(&q->lock);
+  if (*(volatile uint *)P2V(key) != val) {
+    release(&q->lock);
+    return -1;
+  }
+  w.key = key;
+  w.proc = p;
+  w.woken = 0;
+  w.next = 0;
+  for (pp = &q->head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  while (!w.woken && !p->killed)
+    sleep(&w, &q->lock);
+  if (!w.woken) {
+    for (pp = &q->head; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&q->lock);
+  return 0;
+}
+
+static int futex_wake(struct futexq *q, uint key, int n)
+{
+  struct futexwait *w, **pp;
+  int woke;
+
+  woke = 0;
+  acquire(&q->lock);
+  pp = &q->head;
+  while ((w = *pp) != 0 && woke < n) {
+    if (w->key != key) {
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woke++;
+  }
+  release(&q->lock);
+  return woke;
+}
+
+// FUTEX_WAIT returns 0 once woken, or when killed, and -1 at
+// once if the word at va is not val; callers recheck the word
+// either way.  FUTEX_WAKE returns how many it woke.
+int futex(uint va, int op, uint val)
+{
+  uint key;
+
+  if ((key = futexkey(myproc(), va)) == 0)
+    return -1;
+  switch (op) {
+  case FUTEX_WAIT:
+    return futex_wait(queue(key), key, val);
+  case FUTEX_WAKE:
+    return futex_wake(queue(key), key, val > NPROC ? NPROC : val);
+  }
+  return -1;
+}
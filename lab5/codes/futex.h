@@ -0,0 +1,3 @@
+// Operations for futex().
+#define FUTEX_WAIT  0  // sleep if the word still holds val
+#define FUTEX_WAKE  1  // wake up to val processes sleeping on the word
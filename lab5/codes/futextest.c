@@ -0,0 +1,301 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "usync.h"
+
+// futex() and the usync.c library against the kernel's locks.
+//
+// Locks: nproc processes share n lock/unlock pairs, adding one to
+// a counter in shared memory under the lock each time, first
+// alone (nproc 1) and then together.  A umutex enters the kernel
+// only to wait; test_acquire(), plock_acquire() and
+// rwlock_write_acquire() are a system call every time.
+//
+// Then a bounded buffer on two semaphores, a condition variable
+// ping-pong between two processes, and nproc processes meeting at
+// a barrier, each checked for the right result.
+//
+// futextest [nproc [n]]
+
+#define MAXPROC 16
+#define NRING 8
+
+struct shared {
+  struct umutex m;
+  struct ucond cv;
+  struct usem full, empty;
+  struct ubarrier bar;
+  volatile uint counter;
+  volatile uint turn;
+  volatile uint bad;
+  uint ring[NRING];
+  uint head, tail;
+  uint slot[MAXPROC];
+} *sh;
+
+enum { UMUTEX, TESTLOCK, PLOCK, RWLOCK, NKIND };
+char *kindname[NKIND] = { "umutex", "test_acquire", "plock", "rwlock" };
+
+void lock(int kind)
+{
+  switch (kind)
+  {
+  case UMUTEX:
+    umutex_lock(&sh->m);
+    break;
+  case TESTLOCK:
+    test_acquire();
+    break;
+  case PLOCK:
+    plock_acquire(0);
+    break;
+  case RWLOCK:
+    rwlock_write_acquire();
+    break;
+  }
+}
+
+void unlock(int kind)
+{
+  switch (kind)
+  {
+  case UMUTEX:
+    umutex_unlock(&sh->m);
+    break;
+  case TESTLOCK:
+    test_release();
+    break;
+  case PLOCK:
+    plock_release();
+    break;
+  case RWLOCK:
+    rwlock_write_release();
+    break;
+  }
+}
+
+int pids[MAXPROC];
+
+// Start nproc children running f(i, arg).  Returns how many
+// started.
+int spawn(int nproc, void (*f)(int, int), int arg)
+{
+  int i;
+
+  for (i = 0; i < nproc; i++)
+  {
+    if ((pids[i] = fork()) < 0)
+    {
+      printf(1, "futextest: fork failed after %d\n", i);
+      return i;
+    }
+    if (pids[i] == 0)
+    {
+      f(i, arg);
+      exit();
+    }
+  }
+  return nproc;
+}
+
+// Wait for n children, first killing them if they are waiting
+// for ones that never started.
+void reap(int n, int kill_them)
+{
+  int i;
+
+  for (i = 0; kill_them && i < n; i++)
+    kill(pids[i]);
+  while (n-- > 0)
+    wait();
+}
+
+int each;
+
+void locker(int i, int kind)
+{
+  int j;
+
+  for (j = 0; j < each; j++)
+  {
+    lock(kind);
+    sh->counter++;
+    unlock(kind);
+  }
+}
+
+void locks(int nproc, int n)
+{
+  int k, r, p, np, started;
+  uint t0, t;
+
+  printf(1, "lock\t\tprocs\tpairs\tticks\n");
+  for (k = 0; k < NKIND; k++)
+  {
+    for (r = 0; r < (nproc > 1 ? 2 : 1); r++)
+    {
+      np = r == 0 ? 1 : nproc;
+      umutex_init(&sh->m);
+      sh->counter = 0;
+      each = n / np;
+      t0 = uptime();
+      started = spawn(np, locker, k);
+      reap(started, 0);
+      t = uptime() - t0;
+      p = started * each;
+      printf(1, "%s%s\t%d\t%d\t%d%s\n", kindname[k], strlen(kindname[k]) < 8 ? "\t" : "",
+             started, p, t, sh->counter == p ? "" : " FAILED");
+    }
+  }
+}
+
+void consumer(int i, int arg)
+{
+  uint v;
+
+  for (;;)
+  {
+    usem_wait(&sh->full);
+    umutex_lock(&sh->m);
+    v = sh->ring[sh->tail++ % NRING];
+    sh->counter += v;
+    umutex_unlock(&sh->m);
+    usem_post(&sh->empty);
+    if (v == 0)
+      break;
+  }
+}
+
+// The parent puts 1..n and then a 0 for each consumer into a
+// ring of NRING slots; the consumers add up what they take.
+void semtest(int nproc, int n)
+{
+  int i, started;
+  uint t0, want;
+
+  umutex_init(&sh->m);
+  usem_init(&sh->full, 0);
+  usem_init(&sh->empty, NRING);
+  sh->head = sh->tail = 0;
+  sh->counter = 0;
+  t0 = uptime();
+  if ((started = spawn(nproc, consumer, 0)) == 0)
+    return;
+  for (i = 1; i <= n + started; i++)
+  {
+    usem_wait(&sh->empty);
+    umutex_lock(&sh->m);
+    sh->ring[sh->head++ % NRING] = i <= n ? i : 0;
+    umutex_unlock(&sh->m);
+    usem_post(&sh->full);
+  }
+  reap(started, 0);
+  want = (uint)n * (n + 1) / 2;
+  printf(1, "semaphores: %d items to %d consumers in %d ticks%s\n", n, started,
+         uptime() - t0, sh->counter == want ? "" : " FAILED");
+}
+
+void pingpong(int me, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    umutex_lock(&sh->m);
+    while (sh->turn != me)
+      ucond_wait(&sh->cv, &sh->m);
+    sh->turn = 1 - me;
+    sh->counter++;
+    ucond_signal(&sh->cv);
+    umutex_unlock(&sh->m);
+  }
+}
+
+void condtest(int n)
+{
+  uint t0;
+  int started;
+
+  umutex_init(&sh->m);
+  ucond_init(&sh->cv);
+  sh->turn = 0;
+  sh->counter = 0;
+  t0 = uptime();
+  if ((started = spawn(2, pingpong, n)) != 2)
+  {
+    reap(started, 1);
+    return;
+  }
+  reap(started, 0);
+  printf(1, "condvar: %d handoffs in %d ticks%s\n", sh->counter, uptime() - t0,
+         sh->counter == 2 * n ? "" : " FAILED");
+}
+
+int nbarrier;
+
+// Round r writes r+1 to this process's slot.  Past the barrier
+// every slot must hold r+1, or r+2 from one already ahead.
+void meet(int i, int rounds)
+{
+  int r, j;
+
+  for (r = 0; r < rounds; r++)
+  {
+    sh->slot[i] = r + 1;
+    ubarrier_wait(&sh->bar);
+    for (j = 0; j < nbarrier; j++)
+      if (sh->slot[j] < r + 1 || sh->slot[j] > r + 2)
+        sh->bad = 1;
+  }
+}
+
+void barriertest(int nproc, int rounds)
+{
+  uint t0;
+  int started;
+
+  memset(sh->slot, 0, sizeof(sh->slot));
+  sh->bad = 0;
+  ubarrier_init(&sh->bar, nproc);
+  nbarrier = nproc;
+  t0 = uptime();
+  // Every process must arrive, so there is no carrying on short.
+  if ((started = spawn(nproc, meet, rounds)) != nproc)
+  {
+    reap(started, 1);
+    return;
+  }
+  reap(nproc, 0);
+  printf(1, "barrier: %d processes x %d rounds in %d ticks%s\n", nproc, rounds,
+         uptime() - t0, sh->bad ? " FAILED" : "");
+}
+
+int main(int argc, char *argv[])
+{
+  int nproc, n;
+  char *p;
+
+  nproc = 4;
+  n = 20000;
+  if (argc > 1)
+    nproc = atoi(argv[1]);
+  if (argc > 2)
+    n = atoi(argv[2]);
+  if (nproc < 1 || nproc > MAXPROC || n < nproc)
+  {
+    printf(1, "usage: futextest [nproc [n]]\n");
+    exit();
+  }
+  if ((p = mapshared((sizeof(*sh) + 4095) / 4096)) == (char *)-1)
+  {
+    printf(1, "futextest: mapshared failed\n");
+    exit();
+  }
+  sh = (struct shared *)p;
+
+  locks(nproc, n);
+  semtest(nproc, n / 10);
+  condtest(n / 10);
+  barriertest(nproc, n / 100);
+  exit();
+}
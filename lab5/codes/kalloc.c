@@ -1,6 +1,31 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Free memory is kept by a binary buddy allocator: a block of
+// order k is 2^k physically contiguous pages aligned to its own
+// size, and freeing a block merges it with its buddy whenever
+// that is free too.  kalloc_order() hands out runs of up to
+// 2^MAXORDER pages (4MB, one superpage).
+//
+// Each CPU keeps a small cache of free pages in front of the
+// global list, so most kalloc()/kfree() calls never touch
+// kmem.lock; pages move to and from the global list KBATCH
+// at a time.
+//
+// Idle CPUs also zero free pages ahead of time into a small
+// pool (kzero), so kalloc_zeroed() can usually hand out a
+// clean page without a memset() on the caller's path.  The pool
+// is binned by colour like the CPU caches below, so coloured
+// user pages come from it too.
+//
+// A CPU's cache is binned by page colour: the low bits of the
+// page number, which pick the slice of the L2 cache a page maps
+// to.  kalloc_color() asks for a given colour, so that user
+// pages next to each other in virtual memory (see allocuvm())
+// do not fight over the same cache sets.  It refills a CPU's
+// bins with an aligned block of NCOLOR pages, one of each
+// colour.  setcolor(0) turns it off for comparison.
 
 #include "types.h"
 #include "defs.h"
@@ -8,21 +33,61 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "kalloc.h"
+#include "percpu.h"
+#include "lockstat.h"
+
+#define KMAG    64  // most pages a CPU caches before draining
+#define KBATCH  32  // pages moved per refill or drain
+#define KZEROMAX 256  // most pre-zeroed pages kept in kzero
+#define NPAGES  (PHYSTOP/PGSIZE)
+#define MAXORDER SUPERORDER  // largest block kept, in log2 pages
+#define PGCOLOR(v) ((V2P(v) / PGSIZE) & (NCOLOR-1))
 
 void freerange(void *vstart, void *vend);
+static struct run *kzero_pop(int);
+static int buddy_selftest(void);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
 struct run {
   struct run *next;
+  struct run *prev;   // only used on kmem.free[]
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run *free[MAXORDER+1];  // free blocks of each order
+  uint nfree[MAXORDER+1];
 } kmem;
 
+// For each physical page, 1 + the order of the free block
+// that starts there, or 0 if no free block starts there.
+static uchar pgorder[NPAGES];
+
+// Pages zeroed by kzero_idle(), waiting for kalloc_zeroed().
+struct {
+  struct spinlock lock;
+  struct run *bin[NCOLOR];  // zeroed pages of each colour
+  int nfree;
+  int next;                 // bin kzero_pop(-1) looks in first
+} kzero;
+
+// Per-CPU page cache.  Only its own CPU adds to it; the lock
+// is there for other CPUs stealing when memory runs low.
+struct kcpu {
+  struct spinlock lock;
+  struct run *bin[NCOLOR];  // free pages of each colour
+  int nfree;
+  int last;                 // colour of the page freed last
+  struct kallocstat stat;
+};
+static DEFINE_PERCPU(struct kcpu, kcpus);
+
+int kcolor = 1;  // does kalloc_color() look at the colour?
+static int buddyok;  // did buddy_selftest() pass at boot?
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,7 +96,7 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
-  initlock(&kmem.lock, "kmem");
+  initlock_type(&kmem.lock, "kmem", LOCK_MCS);
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -39,17 +104,185 @@ kinit1(void *vstart, void *vend)
 void
 kinit2(void *vstart, void *vend)
 {
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&per_cpu(kcpus, i).lock, "kcpu");
+  initlock(&kzero.lock, "kzero");
   freerange(vstart, vend);
+  // Nothing else allocates until use_lock is set, so the free
+  // lists are the test's alone.
+  buddyok = buddy_selftest();
   kmem.use_lock = 1;
 }
 
+// Hand the range over in the largest aligned blocks that fit.
 void
 freerange(void *vstart, void *vend)
 {
   char *p;
+  int k;
+
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
-    kfree(p);
+  while(p + PGSIZE <= (char*)vend){
+    for(k = MAXORDER; k > 0; k--)
+      if(V2P(p) % (PGSIZE << k) == 0 && p + (PGSIZE << k) <= (char*)vend)
+        break;
+    kfree_order(p, k);
+    p += PGSIZE << k;
+  }
+}
+
+static void
+buddy_insert(struct run *r, int k)
+{
+  r->prev = 0;
+  r->next = kmem.free[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[k] = r;
+  kmem.nfree[k]++;
+  pgorder[V2P(r) / PGSIZE] = k + 1;
+}
+
+static void
+buddy_remove(struct run *r, int k)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nfree[k]--;
+  pgorder[V2P(r) / PGSIZE] = 0;
+}
+
+// Take a block of order k, splitting a larger one if needed.
+// Caller holds kmem.lock if kmem.use_lock is set.
+static struct run*
+buddy_alloc(int k)
+{
+  struct run *r;
+  int j;
+
+  for(j = k; j <= MAXORDER && kmem.free[j] == 0; j++)
+    ;
+  if(j > MAXORDER)
+    return 0;
+  r = kmem.free[j];
+  buddy_remove(r, j);
+  // Give back the upper half at each step down.
+  while(j > k){
+    j--;
+    buddy_insert((struct run*)((char*)r + (PGSIZE << j)), j);
+  }
+  return r;
+}
+
+// Free a block of order k, merging it with its buddy for
+// as long as the buddy is a free block of the same order.
+// Caller holds kmem.lock if kmem.use_lock is set.
+static void
+buddy_free(char *v, int k)
+{
+  uint pfn, bpfn;
+
+  pfn = V2P(v) / PGSIZE;
+  while(k < MAXORDER){
+    bpfn = pfn ^ (1 << k);
+    if(bpfn >= NPAGES || pgorder[bpfn] != k + 1)
+      break;
+    buddy_remove((struct run*)P2V(bpfn * PGSIZE), k);
+    pfn &= ~(1 << k);
+    k++;
+  }
+  buddy_insert((struct run*)P2V(pfn * PGSIZE), k);
+}
+
+// Add r to kc's bin for its colour.  Caller holds kc->lock.
+static void
+kc_push(struct kcpu *kc, struct run *r)
+{
+  int c = PGCOLOR(r);
+
+  r->next = kc->bin[c];
+  kc->bin[c] = r;
+  kc->nfree++;
+  kc->last = c;
+}
+
+// Take a page of colour c from kc, or of any colour if c is -1,
+// starting with the colour freed last since that page is the
+// most likely to still be in the cache.  Caller holds kc->lock.
+static struct run*
+kc_pop(struct kcpu *kc, int c)
+{
+  struct run *r;
+  int i;
+
+  if(c < 0){
+    for(i = 0; i < NCOLOR; i++){
+      c = (kc->last + i) & (NCOLOR-1);
+      if(kc->bin[c])
+        break;
+    }
+  }
+  if((r = kc->bin[c]) != 0){
+    kc->bin[c] = r->next;
+    kc->nfree--;
+  }
+  return r;
+}
+
+// Take n (at most kc->nfree) pages out of kc as a chain, one
+// colour after another, so what is left stays evenly spread.
+// Caller holds kc->lock.
+static struct run*
+kc_take(struct kcpu *kc, int n)
+{
+  struct run *head, *r;
+  int c;
+
+  head = 0;
+  for(c = kc->last + 1; n > 0; c++){
+    if((r = kc->bin[c & (NCOLOR-1)]) == 0)
+      continue;
+    kc->bin[c & (NCOLOR-1)] = r->next;
+    kc->nfree--;
+    r->next = head;
+    head = r;
+    n--;
+  }
+  return head;
+}
+
+// If kc holds more than KMAG pages, take KBATCH of them out
+// for kmem_give().  Caller holds kc->lock.
+static struct run*
+kc_drain(struct kcpu *kc)
+{
+  if(kc->nfree <= KMAG)
+    return 0;
+  kc->stat.drains++;
+  return kc_take(kc, KBATCH);
+}
+
+// Hand a chain of single pages back to the buddy allocator.
+static void
+kmem_give(struct run *batch)
+{
+  struct run *r;
+
+  if(batch == 0)
+    return;
+  acquire(&kmem.lock);
+  while(batch){
+    r = batch;
+    batch = batch->next;
+    buddy_free((char*)r, 0);
+  }
+  release(&kmem.lock);
 }
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
@@ -59,21 +292,72 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct run *r, *batch;
+  struct kcpu *kc;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+#ifdef KALLOC_JUNK
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    buddy_free(v, 0);
+    return;
+  }
+
+  // Interrupts stay off until we are done so that we
+  // cannot move to another CPU halfway through.
+  pushcli();
+  kc = &this_cpu(kcpus);
+  acquire(&kc->lock);
+  kc_push(kc, r);
+  batch = kc_drain(kc);
+  release(&kc->lock);
+  kmem_give(batch);
+  popcli();
+}
+
+// Take up to n single pages from the buddy allocator.
+// Returns them as a chain and their number in *got.
+// Caller holds kmem.lock if kmem.use_lock is set.
+static struct run*
+kmem_take(int n, int *got)
+{
+  struct run *r, *head;
+
+  head = 0;
+  for(*got = 0; *got < n && (r = buddy_alloc(0)) != 0; (*got)++){
+    r->next = head;
+    head = r;
+  }
+  return head;
+}
+
+// Take about half of some other CPU's cache.
+static struct run*
+ksteal(struct kcpu *self, int *got)
+{
+  struct kcpu *kc;
+  struct run *head;
+  int i;
+
+  *got = 0;
+  for(i = 0; i < NCPU; i++){
+    kc = &per_cpu(kcpus, i);
+    if(kc == self || kc->nfree == 0)
+      continue;
+    acquire(&kc->lock);
+    *got = (kc->nfree + 1) / 2;
+    head = kc_take(kc, *got);
+    release(&kc->lock);
+    if(head)
+      return head;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -81,16 +365,385 @@ kfree(char *v)
 // Returns 0 if the memory cannot be allocated.
 char*
 kalloc(void)
+{
+  struct run *r, *batch, *next;
+  struct kcpu *kc;
+  int n, stolen;
+
+  if(!kmem.use_lock)
+    return (char*)kmem_take(1, &n);
+
+  pushcli();
+  kc = &this_cpu(kcpus);
+  acquire(&kc->lock);
+  r = kc_pop(kc, -1);
+  if(r){
+    kc->stat.hits++;
+    release(&kc->lock);
+    popcli();
+    return (char*)r;
+  }
+  release(&kc->lock);
+
+  // Slow path: refill from the global list, or failing
+  // that from another CPU.  No per-CPU lock is held while
+  // taking another, so two stealing CPUs cannot deadlock.
+  stolen = 0;
+  acquire(&kmem.lock);
+  batch = kmem_take(KBATCH, &n);
+  release(&kmem.lock);
+  if(batch == 0){
+    batch = ksteal(kc, &n);
+    stolen = 1;
+  }
+  if(batch == 0){
+    // Last resort: a page the idle loop already zeroed.
+    r = kzero_pop(-1);
+    popcli();
+    return (char*)r;
+  }
+
+  r = batch;
+  batch = batch->next;
+  acquire(&kc->lock);
+  while(batch){
+    next = batch->next;
+    kc_push(kc, batch);
+    batch = next;
+  }
+  if(stolen)
+    kc->stat.steals++;
+  else
+    kc->stat.refills++;
+  release(&kc->lock);
+  popcli();
+  return (char*)r;
+}
+
+// Allocate one page of colour color (mod NCOLOR), or of any
+// colour if color is -1, none is free or colouring is off.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_color(int color)
+{
+  struct run *r, *blk, *batch;
+  struct kcpu *kc;
+  int c, i;
+
+  if(!kmem.use_lock || !kcolor || color < 0)
+    return kalloc();
+
+  c = color & (NCOLOR-1);
+  pushcli();
+  kc = &this_cpu(kcpus);
+  acquire(&kc->lock);
+  if((r = kc_pop(kc, c)) != 0){
+    kc->stat.hits++;
+    kc->stat.colorhits++;
+    release(&kc->lock);
+    popcli();
+    return (char*)r;
+  }
+  release(&kc->lock);
+
+  // An aligned block of NCOLOR pages has one of each colour.
+  acquire(&kmem.lock);
+  blk = buddy_alloc(COLORORDER);
+  release(&kmem.lock);
+  if(blk == 0){
+    popcli();
+    if((r = (struct run*)kalloc()) != 0){
+      pushcli();
+      this_cpu(kcpus).stat.colormisses++;
+      popcli();
+    }
+    return (char*)r;
+  }
+
+  r = (struct run*)((char*)blk + c*PGSIZE);
+  acquire(&kc->lock);
+  for(i = 0; i < NCOLOR; i++)
+    if(i != c)
+      kc_push(kc, (struct run*)((char*)blk + i*PGSIZE));
+  kc->stat.refills++;
+  kc->stat.colorhits++;
+  batch = kc_drain(kc);
+  release(&kc->lock);
+  kmem_give(batch);
+  popcli();
+  return (char*)r;
+}
+
+// Turn kalloc_color() on or off.  Returns the old setting.
+int
+kalloc_setcolor(int on)
+{
+  int old = kcolor;
+
+  kcolor = on != 0;
+  return old;
+}
+
+// Free the 2^order pages starting at v, which must have been
+// returned by kalloc_order() with the same order (or handed
+// over by freerange()).
+void
+kfree_order(char *v, int order)
+{
+  if(order < 0 || order > MAXORDER || (uint)V2P(v) % (PGSIZE << order) ||
+     v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+
+#ifdef KALLOC_JUNK
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+#endif
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  buddy_free(v, order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their total size.  Bypasses the per-CPU caches.
+// Returns 0 if no free block is large enough.
+char*
+kalloc_order(int order)
 {
   struct run *r;
 
+  if(order < 0 || order > MAXORDER)
+    panic("kalloc_order");
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = buddy_alloc(order);
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Allocate one 4MB-aligned superpage.  Returns 0 if no whole
+// superpage is left; callers are expected to fall back to
+// kalloc().
+char*
+kalloc_super(void)
+{
+  return kalloc_order(SUPERORDER);
+}
+
+void
+kfree_super(char *v)
+{
+  kfree_order(v, SUPERORDER);
+}
+
+// Take a page from the kzero pool: of colour c, or of any
+// colour if c is -1.  Returns 0 if there is none.
+static struct run*
+kzero_pop(int c)
+{
+  struct run *r;
+  int i;
+
+  r = 0;
+  acquire(&kzero.lock);
+  if(c >= 0){
+    if((r = kzero.bin[c]) != 0)
+      kzero.bin[c] = r->next;
+  } else {
+    for(i = 0; i < NCOLOR && r == 0; i++){
+      c = (kzero.next + i) & (NCOLOR-1);
+      if((r = kzero.bin[c]) != 0)
+        kzero.bin[c] = r->next;
+    }
+    kzero.next = (c + 1) & (NCOLOR-1);
+  }
+  if(r)
+    kzero.nfree--;
+  release(&kzero.lock);
+  return r;
+}
+
+// Allocate one 4096-byte page filled with zeros, of colour
+// color (see kalloc_color()), preferably one the idle loop has
+// already cleared.  If the pool has none of that colour, a page
+// of the right colour is cleared here instead.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_color_zeroed(int color)
+{
+  struct run *r;
+  char *v;
+
+  r = 0;
+  if(kmem.use_lock){
+    pushcli();
+    r = kzero_pop(kcolor && color >= 0 ? color & (NCOLOR-1) : -1);
+    if(r)
+      this_cpu(kcpus).stat.zhits++;
+    else
+      this_cpu(kcpus).stat.zmisses++;
+    popcli();
+  }
+  if(r){
+    // The pool's link pointer is the only non-zero word.
+    r->next = 0;
+    return (char*)r;
+  }
+  if((v = kalloc_color(color)) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// A zeroed page of any colour.
+char*
+kalloc_zeroed(void)
+{
+  return kalloc_color_zeroed(-1);
+}
+
+// Called by an idle CPU's scheduler loop with no locks held
+// and interrupts on: zero free pages and add them to the kzero
+// pool, an aligned block of NCOLOR at a time so that every
+// colour is stocked alike.  Returns 0 if there was nothing to
+// do, in which case the caller may halt.
+int
+kzero_idle(void)
+{
+  struct run *r;
+  char *blk;
+  int i, n;
+
+  if(!kmem.use_lock || kzero.nfree >= KZEROMAX)
+    return 0;
+  acquire(&kmem.lock);
+  n = NCOLOR;
+  if((blk = (char*)buddy_alloc(COLORORDER)) == 0){
+    blk = (char*)kmem_take(1, &i);
+    n = 1;
+  }
+  release(&kmem.lock);
+  if(blk == 0)
+    return 0;
+
+  memset(blk, 0, n*PGSIZE);
+
+  acquire(&kzero.lock);
+  for(i = 0; i < n; i++){
+    r = (struct run*)(blk + i*PGSIZE);
+    r->next = kzero.bin[PGCOLOR(r)];
+    kzero.bin[PGCOLOR(r)] = r;
+  }
+  kzero.nfree += n;
+  release(&kzero.lock);
+
+  pushcli();
+  this_cpu(kcpus).stat.zfilled += n;
+  popcli();
+  return 1;
+}
+
+// Copy out every CPU's allocator statistics.
+void
+kallocstat(struct kallocstat *ks)
+{
+  struct lockcount lc[NCPU];
+  int i;
+
+  lockprof_percpu(&kmem.lock, lc);
+  for(i = 0; i < NCPU; i++){
+    ks[i] = per_cpu(kcpus, i).stat;
+    ks[i].cached = per_cpu(kcpus, i).nfree;
+    ks[i].lockspins = (uint)lc[i].spin;
+  }
+}
+
+// Print how much memory is free in blocks of each order.
+// Free pages outside superpage-sized blocks are the ones that
+// can no longer back a superpage or large contiguous buffer.
+void
+kallocdump(void)
+{
+  uint total, small;
+  int k;
+
+  acquire(&kmem.lock);
+  total = small = 0;
+  cprintf("\norder \t blocks \t pages\n");
+  for(k = 0; k <= MAXORDER; k++){
+    cprintf("%d \t %d \t\t %d\n", k, kmem.nfree[k], kmem.nfree[k] << k);
+    total += kmem.nfree[k] << k;
+    if(k < SUPERORDER)
+      small += kmem.nfree[k] << k;
+  }
+  release(&kmem.lock);
+  cprintf("free pages %d, %d%% of them outside %d-page blocks\n",
+          total, total ? small * 100 / total : 0, 1 << SUPERORDER);
+}
+
+#define NBTEST 256
+
+// Stress test for the buddy allocator, run once by kinit2()
+// before anything else can allocate: allocate blocks of
+// interleaved orders, check that no two overlap, free them in a
+// different order, and check that every block coalesced back
+// into the same free lists as before.
+static int
+buddy_selftest(void)
+{
+  static char *blk[NBTEST];
+  static int ord[NBTEST];
+  uint before[MAXORDER+1];
+  int i, n, k, ok;
+
+  acquire(&kmem.lock);
+  for(k = 0; k <= MAXORDER; k++)
+    before[k] = kmem.nfree[k];
+  release(&kmem.lock);
+
+  ok = 1;
+  for(n = 0; n < NBTEST; n++){
+    ord[n] = (n * 5) % 7;
+    if((blk[n] = kalloc_order(ord[n])) == 0)
+      break;
+    if(V2P(blk[n]) % (PGSIZE << ord[n])){
+      cprintf("buddy_test: block %d misaligned\n", n);
+      ok = 0;
+    }
+    memset(blk[n], n, PGSIZE << ord[n]);
+  }
+  // An overlap would have overwritten an earlier block's fill.
+  for(i = 0; i < n; i++){
+    if(blk[i][0] != (char)i || blk[i][(PGSIZE << ord[i]) - 1] != (char)i){
+      cprintf("buddy_test: block %d overlaps\n", i);
+      ok = 0;
+    }
+  }
+  for(i = 1; i < n; i += 2)
+    kfree_order(blk[i], ord[i]);
+  for(i = (n - 1) & ~1; i >= 0; i -= 2)
+    kfree_order(blk[i], ord[i]);
+
+  acquire(&kmem.lock);
+  for(k = 0; k <= MAXORDER; k++){
+    if(kmem.nfree[k] != before[k]){
+      cprintf("buddy_test: order %d has %d free blocks, had %d\n",
+              k, kmem.nfree[k], before[k]);
+      ok = 0;
+    }
+  }
+  release(&kmem.lock);
+  cprintf("buddy_test: %d blocks, %s\n", n, ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// The result of the boot-time self-test: 0 if it passed.
+// Running it again on the live allocator would race with
+// every other CPU's allocations.
+int
+buddy_test(void)
+{
+  return buddyok ? 0 : -1;
+}
@@ -0,0 +1,14 @@
+// Per-CPU page allocator statistics, see kallocstat().
+struct kallocstat {
+  uint hits;        // kalloc()s served from this CPU's cache
+  uint refills;     // batches pulled from the global list
+  uint drains;      // batches pushed back to the global list
+  uint steals;      // batches taken from another CPU's cache
+  uint cached;      // pages in this CPU's cache right now
+  uint lockspins;   // cycles this CPU waited for kmem.lock
+  uint zhits;       // kalloc_zeroed()s served pre-zeroed
+  uint zmisses;     // kalloc_zeroed()s that had to memset
+  uint zfilled;     // pages this CPU zeroed while idle
+  uint colorhits;   // kalloc_color()s that got the colour asked for
+  uint colormisses; // kalloc_color()s that had to take another colour
+};
@@ -0,0 +1,72 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kalloc.h"
+
+#define NCHILD 8
+#define NFORK 40
+#define NCPU 8 // run with make qemu CPUS=8
+
+// Fork storm: every child forks and reaps grandchildren that
+// grow their heap, so kernel stacks, page tables and user pages
+// are allocated and freed on all CPUs at once.
+void storm(void)
+{
+  int i, pid;
+
+  for (i = 0; i < NFORK; i++)
+  {
+    pid = fork();
+    if (pid < 0)
+      break;
+    if (pid == 0)
+    {
+      sbrk(16 * 4096);
+      exit();
+    }
+    wait();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  struct kallocstat before[NCPU], after[NCPU];
+  int i, pid;
+
+  printf(1, "Starting kalloc fork storm\n");
+  kallocstat(before);
+
+  for (i = 0; i < NCHILD; i++)
+  {
+    pid = fork();
+    if (pid < 0)
+    {
+      printf(1, "Fork failed\n");
+      exit();
+    }
+    if (pid == 0)
+    {
+      storm();
+      exit();
+    }
+  }
+  for (i = 0; i < NCHILD; i++)
+    wait();
+
+  kallocstat(after);
+  printf(1, "CPU\thits\trefills\tdrains\tsteals\tcached\tkmem spins\tzhits\tzmisses\tzfilled\n");
+  for (i = 0; i < NCPU; i++)
+  {
+    printf(1, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t\t%d\t%d\t%d\n", i,
+           after[i].hits - before[i].hits,
+           after[i].refills - before[i].refills,
+           after[i].drains - before[i].drains,
+           after[i].steals - before[i].steals,
+           after[i].cached,
+           after[i].lockspins - before[i].lockspins,
+           after[i].zhits - before[i].zhits,
+           after[i].zmisses - before[i].zmisses,
+           after[i].zfilled - before[i].zfilled);
+  }
+  exit();
+}
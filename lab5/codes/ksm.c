@@ -0,0 +1,311 @@
+// Same-page merging.
+//
+// Idle CPUs run ksmscan() (proc.c), which has ksm_scan() look
+// at the next batch of frames of the frame table.  A private,
+// writable user page whose owner is not running is checksummed;
+// if the checksum is the same as on the previous pass the page
+// has settled, and it is looked up:
+//
+//  - among the shared pages, by checksum and then contents.  A
+//    match gets the page's PTE, read-only and marked PTE_COW, and
+//    the page itself is freed.
+//  - in a table of pages seen on this or earlier passes, one per
+//    checksum.  If that page still has the same contents it
+//    becomes a shared page and this one is merged into it.
+//    Otherwise this page takes its place in the table.
+//
+// A shared page's frame has pgdir 0 and refcnt counting the PTEs
+// to it.  Writing to one faults into ksm_unshare(), which gives
+// the writer a private copy, or the page itself once it is the
+// last one mapping it.  The kernel breaks sharing the same way
+// before it writes to a user buffer (swappin(), copyout()).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "frame.h"
+#include "ksm.h"
+
+#define KSMBATCH  128    // pages ksm_scan() checksums per tick
+#define KSMSKIP   1024   // frames it looks at per tick, at most
+#define NKHASH    4096   // checksum buckets, a power of two
+#define MAXSHARE  0xffff // refcnt is a ushort
+
+struct {
+  struct spinlock lock;
+  struct frame *stable[NKHASH];    // shared pages, chained by hnext
+  struct frame *unstable[NKHASH];  // a private page last seen with that checksum
+  uint hand;                       // next frame ksm_scan() looks at
+  uint last;                       // tick of the last scan
+  struct ksmstat st;
+} ksm;
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+}
+
+// Never 0, which is what a newly mapped frame starts with.
+static uint
+checksum(struct frame *f)
+{
+  uint *w = (uint*)P2V(FRAME2PA(f));
+  uint h, i;
+
+  h = 2166136261U;
+  for(i = 0; i < PGSIZE/4; i++)
+    h = (h ^ w[i]) * 16777619;
+  return h | 1;
+}
+
+static int
+samepage(struct frame *a, struct frame *b)
+{
+  return memcmp(P2V(FRAME2PA(a)), P2V(FRAME2PA(b)), PGSIZE) == 0;
+}
+
+static pte_t*
+ptefor(struct frame *f)
+{
+  return walkpgdir(f->pgdir, (char*)FRAMEVA(f), 0);
+}
+
+// Take shared page s out of its hash chain.
+static void
+stableunlink(struct frame *s)
+{
+  struct frame **pp;
+
+  for(pp = &ksm.stable[s->csum & (NKHASH-1)]; *pp != s; pp = &(*pp)->hnext)
+    ;
+  *pp = s->hnext;
+  s->hnext = 0;
+  ksm.st.shared--;
+}
+
+// Point f's PTE at shared page s, read-only, and stop treating
+// f as a page of its own.
+static void
+share(struct frame *f, struct frame *s)
+{
+  pte_t *pte = ptefor(f);
+
+  *pte = FRAME2PA(s) | (PTE_FLAGS(*pte) & ~(PTE_W|PTE_A|PTE_D)) | PTE_COW;
+  frame_toshared(f);
+  ksm.st.sharing++;
+}
+
+// A shared page with f's contents, or 0.
+static struct frame*
+stablefind(struct frame *f)
+{
+  struct frame *s;
+
+  for(s = ksm.stable[f->csum & (NKHASH-1)]; s; s = s->hnext)
+    if(s->csum == f->csum && s->refcnt < MAXSHARE && samepage(s, f))
+      return s;
+  return 0;
+}
+
+// If the table holds another private page with f's contents,
+// make it a shared page and return it.
+static struct frame*
+unstablefind(struct frame *f, int (*ok)(struct frame*))
+{
+  struct frame **up = &ksm.unstable[f->csum & (NKHASH-1)], *u = *up;
+
+  // u may have been freed or reused since it was put here.
+  if(u == 0 || u == f || u->pgdir == 0 || u->csum != f->csum || !ok(u))
+    return 0;
+  if((*ptefor(u) & PTE_W) == 0 || !samepage(u, f))
+    return 0;
+  *up = 0;
+  share(u, u);
+  u->refcnt = 1;
+  u->hnext = ksm.stable[u->csum & (NKHASH-1)];
+  ksm.stable[u->csum & (NKHASH-1)] = u;
+  ksm.st.shared++;
+  return u;
+}
+
+// Look at the next batch of frames, merging pages that ok()
+// accepts.  Called with the frame table locked, by an idle CPU:
+// ok() only accepts pages of processes that are not running,
+// and switchuvm() flushes the TLB before they run again.
+void
+ksm_scan(int (*ok)(struct frame*))
+{
+  struct frame *f, *s;
+  uint c, i, n;
+
+  acquire(&ksm.lock);
+  for(i = n = 0; i < KSMSKIP && n < KSMBATCH; i++){
+    f = &frames[ksm.hand];
+    if(++ksm.hand == NFRAME){
+      ksm.hand = 0;
+      ksm.st.passes++;
+    }
+    if(f->pgdir == 0 || !ok(f) || (*ptefor(f) & PTE_W) == 0)
+      continue;
+    ksm.st.scanned++;
+    n++;
+    // Only a page that did not change since the last pass;
+    // one being written to would only be unshared again.
+    c = checksum(f);
+    if(c != f->csum){
+      f->csum = c;
+      continue;
+    }
+    if((s = stablefind(f)) == 0 && (s = unstablefind(f, ok)) == 0){
+      ksm.unstable[c & (NKHASH-1)] = f;
+      continue;
+    }
+    share(f, s);
+    s->refcnt++;
+    ksm.st.merges++;
+    kfree(P2V(FRAME2PA(f)));
+  }
+  release(&ksm.lock);
+}
+
+// Is it time for another batch?  Once per tick, on one CPU.
+int
+ksm_due(void)
+{
+  int due;
+
+  if(frames == 0)
+    return 0;
+  acquire(&ksm.lock);
+  due = ksm.last != ticks;
+  ksm.last = ticks;
+  release(&ksm.lock);
+  return due;
+}
+
+// copyuvm() wants to map the shared page at pa into pgdir too.
+// Returns -1 if it is mapped too often already.
+int
+ksm_dup(pde_t *pgdir, uint pa)
+{
+  struct frame *s = PA2FRAME(pa);
+
+  acquire(&ksm.lock);
+  if(s->refcnt >= MAXSHARE){
+    release(&ksm.lock);
+    return -1;
+  }
+  s->refcnt++;
+  ksm.st.sharing++;
+  release(&ksm.lock);
+  frame_addshared(pgdir);
+  return 0;
+}
+
+// A PTE to the shared page at pa is going away.
+void
+ksm_put(uint pa)
+{
+  struct frame *s = PA2FRAME(pa);
+
+  acquire(&ksm.lock);
+  if(s->pgdir || s->refcnt == 0)
+    panic("ksm_put");
+  ksm.st.sharing--;
+  if(--s->refcnt == 0){
+    stableunlink(s);
+    kfree(P2V(pa));
+  }
+  release(&ksm.lock);
+}
+
+// Give p (the current process) a private, writable page at va
+// in place of a shared one.  Returns -1 if va is not shared or
+// there is no memory.  May sleep.
+int
+ksm_unshare(struct proc *p, uint va)
+{
+  struct frame *s;
+  pte_t *pte;
+  char *mem;
+  uint pa;
+
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_COW)) != (PTE_P|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  s = PA2FRAME(pa);
+
+  acquire(&ksm.lock);
+  if(s->refcnt == 1){
+    // Nobody else maps it: have it back.
+    stableunlink(s);
+    s->refcnt = 0;
+    ksm.st.sharing--;
+    release(&ksm.lock);
+    mem = P2V(pa);
+  } else {
+    release(&ksm.lock);
+    // Only p changes its PTE_COW entries, and shared pages are
+    // never swapped out, so *pte stays put while this sleeps.
+    if((mem = swapalloc(0, uvmcolor(p->pgdir, va))) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    ksm_put(pa);
+  }
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  invlpg((void*)va);
+  frame_insert(p->pgdir, va, V2P(mem), 0);
+
+  acquire(&ksm.lock);
+  ksm.st.unshares++;
+  release(&ksm.lock);
+  return 0;
+}
+
+// Handle a write fault on a shared page of the current process.
+// Returns -1 if that is not what it was.
+int
+ksmfault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va = rcr2();
+  pte_t *pte;
+  int r;
+
+  if(p == 0 || (tf->cs&3) == 0 || va >= p->sz || (tf->err & 2) == 0)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_COW)) != (PTE_P|PTE_COW))
+    return -1;
+  // swapalloc() may have to wait for the disk.
+  sti();
+  if((r = ksm_unshare(p, PGROUNDDOWN(va))) == 0)
+    p->minflt++;
+  cli();
+  return r;
+}
+
+void
+ksm_stat(struct ksmstat *st)
+{
+  acquire(&ksm.lock);
+  *st = ksm.st;
+  release(&ksm.lock);
+}
+
+void
+ksmdump(void)
+{
+  acquire(&ksm.lock);
+  cprintf("ksm: %d shared pages for %d mappings, %d merges, %d unshares, %d passes\n",
+          ksm.st.shared, ksm.st.sharing, ksm.st.merges, ksm.st.unshares,
+          ksm.st.passes);
+  release(&ksm.lock);
+}
@@ -0,0 +1,9 @@
+// Same-page merging statistics, see ksmstat().
+struct ksmstat {
+  uint scanned;     // pages the scanner has looked at
+  uint passes;      // sweeps through the whole frame table
+  uint merges;      // pages freed by pointing their PTE at a shared copy
+  uint unshares;    // writes that needed a private copy again
+  uint shared;      // shared pages right now
+  uint sharing;     // PTEs mapping them; sharing - shared pages are saved
+};
@@ -0,0 +1,106 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ksm.h"
+
+#define PGSIZE 4096
+#define NCHILD 8
+#define NPRINT 10
+#define INTERVAL 100
+
+// The same data in every child: zero pages and pages that only
+// depend on their index.
+int word(int i, int j)
+{
+  return (i % 2) ? (i << 16) ^ j : 0;
+}
+
+// Returns the number of pages that do not hold what the child
+// wrote, with tag added to the first word of each page.
+int check(int *mem, int npages, int tag)
+{
+  int i, j, bad, w;
+
+  bad = 0;
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE / 4; j++)
+    {
+      w = word(i, j) + (j == 0 ? tag : 0);
+      if (mem[i * (PGSIZE / 4) + j] != w)
+      {
+        bad++;
+        break;
+      }
+    }
+  return bad;
+}
+
+void child(int npages)
+{
+  int *mem;
+  int i, j, bad;
+
+  mem = (int *)sbrk(npages * PGSIZE);
+  if (mem == (int *)-1)
+  {
+    printf(1, "ksmtest: sbrk failed\n");
+    exit();
+  }
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE / 4; j++)
+      mem[i * (PGSIZE / 4) + j] = word(i, j);
+
+  // Stay asleep while the scanner merges our pages.
+  sleep(NPRINT * INTERVAL + INTERVAL);
+
+  bad = check(mem, npages, 0);
+  // Writing makes every page private again.
+  for (i = 0; i < npages; i++)
+    mem[i * (PGSIZE / 4)] += getpid();
+  bad += check(mem, npages, getpid());
+  if (bad)
+    printf(1, "ksmtest: pid %d: %d bad pages\n", getpid(), bad);
+  exit();
+}
+
+void show(char *when)
+{
+  struct ksmstat st;
+
+  if (ksmstat(&st) < 0)
+  {
+    printf(1, "ksmtest: ksmstat failed\n");
+    exit();
+  }
+  printf(1, "%s: %d shared pages for %d mappings (%d KB saved), %d merges, %d unshares\n",
+         when, st.shared, st.sharing, (st.sharing - st.shared) * (PGSIZE / 1024),
+         st.merges, st.unshares);
+}
+
+// Start NCHILD processes with identical memory and watch the
+// merger fold it into shared pages, then have them all write to
+// it and check that each got its own copy back.
+int main(int argc, char *argv[])
+{
+  int mb, i;
+
+  mb = 4;
+  if (argc > 1)
+    mb = atoi(argv[1]);
+
+  show("before");
+  for (i = 0; i < NCHILD; i++)
+  {
+    if (fork() == 0)
+      child(mb * (1024 * 1024 / PGSIZE));
+  }
+  for (i = 0; i < NPRINT; i++)
+  {
+    sleep(INTERVAL);
+    show("asleep");
+  }
+  for (i = 0; i < NCHILD; i++)
+    wait();
+  show("after");
+  exit();
+}
@@ -0,0 +1,118 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+// Show the most contended kernel locks:
+//
+//   lockstat [-n top]               profile so far
+//   lockstat [-n top] cmd args...   profile of running cmd alone
+//   lockstat on|off|reset
+//
+// Locks are grouped by name (every pipe is "pipe", every buffer
+// is "sleep lock").  Cycles are in thousands; the three busiest
+// callsites of each lock are listed by the return address of
+// their acquire(), to be looked up in kernel.asm.
+
+#define NSHOW 3
+
+struct lockstat ls[NLOCKPROF];
+
+// Most contended first, then most time spent waiting.
+int before(struct lockcount *a, struct lockcount *b)
+{
+  if (a->contended != b->contended)
+    return a->contended > b->contended;
+  return a->spin > b->spin;
+}
+
+void sort(int n)
+{
+  struct lockstat t;
+  int i, j;
+
+  for (i = 1; i < n; i++)
+  {
+    t = ls[i];
+    for (j = i; j > 0 && before(&t.all, &ls[j - 1].all); j--)
+      ls[j] = ls[j - 1];
+    ls[j] = t;
+  }
+}
+
+void show(struct lockstat *l)
+{
+  int shown[NLOCKSITE], i, j, best;
+
+  printf(1, "%s\t%d\t%d\t%d\t%d\t%d\n", l->name, l->nlocks,
+         l->all.acq, l->all.contended,
+         (uint)(l->all.spin >> 10), (uint)(l->all.hold >> 10));
+  for (i = 0; i < NLOCKSITE; i++)
+    shown[i] = l->site[i].pc == 0;
+  for (i = 0; i < NSHOW; i++)
+  {
+    best = -1;
+    for (j = 0; j < NLOCKSITE; j++)
+      if (!shown[j] && (best < 0 || before(&l->site[j].n, &l->site[best].n)))
+        best = j;
+    if (best < 0)
+      break;
+    shown[best] = 1;
+    printf(1, "  at 0x%x\t\t%d\t%d\t%d\t%d\n", l->site[best].pc,
+           l->site[best].n.acq, l->site[best].n.contended,
+           (uint)(l->site[best].n.spin >> 10),
+           (uint)(l->site[best].n.hold >> 10));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int top, n, i, old;
+
+  if (argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0 ||
+                    strcmp(argv[1], "reset") == 0))
+  {
+    if (lockprof(argv[1][0] == 'r' ? LOCKPROF_RESET :
+                 argv[1][1] == 'n' ? LOCKPROF_ON : LOCKPROF_OFF) < 0)
+      printf(2, "lockstat: kernel built without LOCKPROF\n");
+    exit();
+  }
+
+  top = 10;
+  argv++;
+  argc--;
+  if (argc >= 2 && strcmp(argv[0], "-n") == 0)
+  {
+    top = atoi(argv[1]);
+    argv += 2;
+    argc -= 2;
+  }
+
+  old = -1;
+  if (argc > 0)
+  {
+    old = lockprof(LOCKPROF_ON);
+    lockprof(LOCKPROF_RESET);
+    if (fork() == 0)
+    {
+      exec(argv[0], argv);
+      printf(2, "lockstat: exec %s failed\n", argv[0]);
+      exit();
+    }
+    wait();
+  }
+
+  if ((n = lockstat(ls, NLOCKPROF)) < 0)
+  {
+    printf(2, "lockstat: kernel built without LOCKPROF\n");
+    exit();
+  }
+  if (old == 0)
+    lockprof(LOCKPROF_OFF);
+
+  sort(n);
+  printf(1, "NAME\tLOCKS\tACQ\tCONTEND\tKSPIN\tKHOLD\n");
+  for (i = 0; i < n && i < top; i++)
+    show(&ls[i]);
+  exit();
+}
@@ -0,0 +1,26 @@
+// Lock profiling, see lockstat() and lockprof().
+#define NLOCKPROF 64      // lock names profiled
+#define NLOCKSITE 8       // callsites kept for each lock name
+
+#define LOCKPROF_OFF   0  // lockprof() commands
+#define LOCKPROF_ON    1
+#define LOCKPROF_RESET 2
+
+// Counters for a lock, or for one place that acquires it.
+struct lockcount {
+  uint acq;         // acquisitions
+  uint contended;   // acquisitions that had to wait
+  uint64 spin;      // cycles spent waiting
+  uint64 hold;      // cycles it was held
+};
+
+// All locks initialized with one name.
+struct lockstat {
+  char name[16];
+  uint nlocks;             // locks initialized with this name
+  struct lockcount all;
+  struct {
+    uint pc;               // return address of the acquire(), 0 if unused
+    struct lockcount n;
+  } site[NLOCKSITE];
+};
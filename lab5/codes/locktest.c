@@ -23,8 +23,11 @@ main(int argc, char *argv[])
 
   printf(1, "Starting lock profiling test on tickslock...\n");
 
-  getlockstat(scores);
-  printf(1, "Initial scores:\n");
+  if(getlockstat(scores) < 0){
+    printf(2, "locktest: kernel built without LOCKPROF\n");
+    exit();
+  }
+  printf(1, "Initial cycles waited per acquire:\n");
   for(i = 0; i < NCPU; i++)
     printf(1, "CPU %d: %d\n", i, (int)scores[i]);
 
@@ -45,7 +48,7 @@ main(int argc, char *argv[])
   }
 
   getlockstat(scores);
-  printf(1, "\nFinal scores (Contention Metrics):\n");
+  printf(1, "\nFinal cycles waited per acquire (contention):\n");
   for(i = 0; i < NCPU; i++){
     printf(1, "CPU %d: %d\n", i, (int)scores[i]);
   }
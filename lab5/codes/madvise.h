@@ -0,0 +1,7 @@
+// Advice for madvise().
+#define MADV_NORMAL      0  // no special treatment
+#define MADV_SEQUENTIAL  1  // read ahead on faults, evict behind them
+#define MADV_WILLNEED    2  // bring the pages in now
+#define MADV_DONTNEED    3  // free the pages; they read as zeros afterwards
+#define MADV_FREE        4  // free the pages if memory runs short and they
+                            // have not been written to since
@@ -0,0 +1,102 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "memstat.h"
+#include "madvise.h"
+
+#define PGSIZE 4096
+#define MB (1024 * 1024)
+
+struct memstat ms[NPROC];
+
+// This process's resident pages.
+int rss(void)
+{
+  int i, n, pid;
+
+  pid = getpid();
+  n = memstat(ms, NPROC);
+  for (i = 0; i < n; i++)
+    if (ms[i].pid == pid)
+      return ms[i].rss;
+  return -1;
+}
+
+// Pages in [first, first+n) whose first word is not want, or
+// (if want is -1) not the page number.
+int check(int *mem, int first, int n, int want)
+{
+  int i, bad;
+
+  bad = 0;
+  for (i = first; i < first + n; i++)
+    if (mem[i * (PGSIZE / 4)] != (want == -1 ? i : want))
+      bad++;
+  return bad;
+}
+
+void fill(int *mem, int first, int n)
+{
+  int i;
+
+  for (i = first; i < first + n; i++)
+    mem[i * (PGSIZE / 4)] = i;
+}
+
+int main(int argc, char *argv[])
+{
+  int mb, npages, half, r0, bad;
+  int *mem;
+  char *p;
+
+  mb = 16;
+  if (argc > 1)
+    mb = atoi(argv[1]);
+  npages = mb * (MB / PGSIZE);
+  half = npages / 2;
+
+  mem = (int *)sbrk(npages * PGSIZE);
+  if (mem == (int *)-1)
+  {
+    printf(1, "madvtest: sbrk failed\n");
+    exit();
+  }
+  fill(mem, 0, npages);
+  r0 = rss();
+  printf(1, "filled %d pages: rss %d\n", npages, r0);
+
+  if (madvise((char *)mem + half * PGSIZE, half * PGSIZE, MADV_DONTNEED) < 0)
+    printf(1, "madvtest: DONTNEED failed\n");
+  printf(1, "DONTNEED second half: rss %d (%d freed)\n", rss(), r0 - rss());
+  bad = check(mem, half, half, 0);
+  printf(1, "second half reads back as zeros: %d bad pages, rss %d\n", bad, rss());
+
+  madvise((char *)mem + half * PGSIZE, half * PGSIZE, MADV_DONTNEED);
+  madvise((char *)mem + half * PGSIZE, half * PGSIZE, MADV_WILLNEED);
+  printf(1, "DONTNEED then WILLNEED: rss %d\n", rss());
+
+  if (madvise(mem, half * PGSIZE, MADV_FREE) < 0)
+    printf(1, "madvtest: FREE failed\n");
+  bad = check(mem, 0, half, -1);
+  printf(1, "FREE first half, no memory pressure: %d bad pages, rss %d\n", bad, rss());
+
+  madvise(mem, npages * PGSIZE, MADV_SEQUENTIAL);
+  bad = check(mem, 0, half, -1);
+  madvise(mem, npages * PGSIZE, MADV_NORMAL);
+  printf(1, "SEQUENTIAL read: %d bad pages\n", bad);
+
+  if (madvise((char *)mem + 1, PGSIZE, MADV_DONTNEED) == 0 ||
+      madvise(mem, (npages + 1) * PGSIZE, MADV_DONTNEED) == 0 ||
+      madvise(mem, PGSIZE, 99) == 0)
+    printf(1, "madvtest: bad arguments accepted\n");
+
+  // free() hands big blocks back with MADV_DONTNEED.
+  r0 = rss();
+  p = malloc(4 * MB);
+  memset(p, 1, 4 * MB);
+  printf(1, "malloc 4MB: rss %d -> %d\n", r0, rss());
+  free(p);
+  printf(1, "free: rss %d\n", rss());
+  exit();
+}
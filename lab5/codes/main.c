@@ -31,6 +31,10 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  rcuinit();       // read-copy update
+  piinit();        // priority inheritance
+  futexinit();     // futex wait queues
+  shminit();       // shared memory segments
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
@@ -39,10 +43,13 @@ main(void)
 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  slabinit();      // small object caches
+  pipeinit();      // pipe cache
+  frameinit();     // frame table
+  plock_init(&global_plock, "global_plock"); // lock behind plock_acquire()
 
   userinit();      // first user process
   mpmain();        // finish this processor's setup
-  plock_init(&global_plock, "global_plock");
 }
 
 // Other CPUs jump here from entryother.S.
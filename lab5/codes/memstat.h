@@ -0,0 +1,13 @@
+// One process's memory behaviour, see memstat().
+struct memstat {
+  int pid;
+  int state;        // enum procstate
+  char name[16];
+  uint minflt;      // page faults served without the disk
+  uint majflt;      // page faults that read the disk
+  uint rss;         // resident pages
+  uint swapped;     // pages in swap
+  uint wss;         // working set estimate, in pages
+  uint pff;         // major faults in the last sampling interval
+  int thrashing;    // held back by the PFF controller
+};
@@ -0,0 +1,65 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "memstat.h"
+
+#define PGSIZE 4096
+
+char *states[] = {"unused", "embryo", "sleep", "runble", "run", "zombie"};
+
+struct memstat ms[NPROC];
+
+// Processes faulting to disk the most come first.
+void sort(int n)
+{
+  struct memstat t;
+  int i, j;
+
+  for (i = 1; i < n; i++)
+  {
+    t = ms[i];
+    for (j = i; j > 0 && (ms[j - 1].pff < t.pff ||
+                          (ms[j - 1].pff == t.pff && ms[j - 1].majflt < t.majflt));
+         j--)
+      ms[j] = ms[j - 1];
+    ms[j] = t;
+  }
+}
+
+// Show the memory behaviour of every process, sorted by page
+// fault frequency: memtop [rounds [ticks between them]].
+// Sizes are in KB; PFF is major faults per sampling interval,
+// and a * marks processes the PFF controller is holding back.
+int main(int argc, char *argv[])
+{
+  int rounds, delay, r, i, n;
+
+  rounds = 1;
+  delay = 100;
+  if (argc > 1)
+    rounds = atoi(argv[1]);
+  if (argc > 2)
+    delay = atoi(argv[2]);
+
+  for (r = 0; r < rounds; r++)
+  {
+    if (r > 0)
+      sleep(delay);
+    if ((n = memstat(ms, NPROC)) < 0)
+    {
+      printf(1, "memtop: memstat failed\n");
+      exit();
+    }
+    sort(n);
+    printf(1, "PID\tSTATE\tRSS\tSWAP\tWSS\tMINFLT\tMAJFLT\tPFF\tNAME\n");
+    for (i = 0; i < n; i++)
+      printf(1, "%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d%s\t%s\n",
+             ms[i].pid, states[ms[i].state],
+             ms[i].rss * (PGSIZE / 1024), ms[i].swapped * (PGSIZE / 1024),
+             ms[i].wss * (PGSIZE / 1024), ms[i].minflt, ms[i].majflt,
+             ms[i].pff, ms[i].thrashing ? "*" : "", ms[i].name);
+    printf(1, "\n");
+  }
+  exit();
+}
@@ -10,6 +10,19 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define FSSIZE       4000  // size of file system in blocks
+#define SWAPSIZE   131072  // size of swap area after the file system, in blocks
+#define ZRAMPAGES  4096    // most pages the compressed swap cache may use
+#define WSINTERVAL 100     // ticks between working-set and fault-rate samples
+#define WSWINDOW   200     // ticks a referenced page stays in the working set
+#define PFFHIGH    64      // major faults per interval that mark a process thrashing
+#define PFFLOW     16      // major faults per interval that clear the mark
+#define PFFDELAY   1       // ticks a thrashing process waits at each swap fault
+#define NSEQ       4       // MADV_SEQUENTIAL ranges per process
+#define SEQRA      8       // pages read ahead of a fault in a sequential range
+#define COLORORDER 4       // log2 of the number of page colours:
+#define NCOLOR     (1 << COLORORDER)  // L2 size / (ways * page size)
+#define NSHM       16      // shared memory segments per system
+#define NSHMPG     16      // most pages in a shared memory segment
 #define MAXPATH     128
 #define QUANTUM      3
@@ -0,0 +1,19 @@
+// Per-CPU variables.
+//
+// DEFINE_PERCPU(type, name) gives each CPU its own copy of
+// name, on cache lines of its own so that CPUs updating their
+// copies never invalidate each other's.  this_cpu(name) is the
+// running CPU's copy (interrupts off, see cpuid()), and
+// per_cpu(name, i) that of CPU i.  DECLARE_PERCPU makes one
+// visible to other files.
+
+#define CACHELINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHELINE)))
+
+#define DEFINE_PERCPU(type, name) \
+  struct percpu_##name { type v; } CACHE_ALIGNED name[NCPU]
+#define DECLARE_PERCPU(type, name) \
+  extern struct percpu_##name { type v; } CACHE_ALIGNED name[NCPU]
+
+#define per_cpu(name, i) ((name)[i].v)
+#define this_cpu(name) per_cpu(name, cpuid())
@@ -0,0 +1,145 @@
+// Priority inheritance for sleeping locks.
+//
+// A process runs at its effective priority: its own, or that of
+// the most urgent process waiting for a lock it holds, if that is
+// better (lower).  Waiters may themselves be owners boosted by
+// others, and the owner they wait for may be blocked on yet
+// another lock, so a change is passed down the chain of owners.
+//
+// Only contended locks cost anything: the lock's own spinlock
+// covers taking and dropping a lock nobody waits for.  pilock
+// covers the rest: waiter lists, boost lists, blockedon and
+// effprio.  Lock order is the lock's spinlock, then pilock.
+//
+// This is about scheduling priority, where lower is more urgent.
+// The priority a plock waiter asks with only orders the plock's
+// queue.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "pi.h"
+
+// Longest chain of owners a change is passed down; longer ones
+// are deadlocked anyway.
+#define PIDEPTH 8
+
+struct spinlock pilock;
+
+void piinit(void)
+{
+  initlock(&pilock, "pi");
+}
+
+void pi_init(struct pi *pi)
+{
+  pi->owner = 0;
+  pi->waiters = 0;
+  pi->nextboost = 0;
+}
+
+// The priority p should run at.  Caller holds pilock.
+static int effective(struct proc *p)
+{
+  struct pi *l;
+  struct proc *w;
+  int e;
+
+  e = p->priority;
+  for (l = p->boosts; l; l = l->nextboost)
+    for (w = l->waiters; w; w = w->piwnext)
+      if (w->effprio < e)
+        e = w->effprio;
+  return e;
+}
+
+// Bring p's effective priority up to date, and then that of the
+// owner it is blocked behind, and so on while anything changes.
+// The CPU whose queue p is on, or that runs it, is told to
+// reschedule.  Caller holds pilock.
+static void pi_chain(struct proc *p)
+{
+  int depth, e;
+
+  for (depth = 0; p && depth < PIDEPTH; depth++) {
+    if ((e = effective(p)) == p->effprio)
+      break;
+    p->effprio = e;
+    if (p->state == RUNNABLE || p->state == RUNNING)
+      cpus[p->cpu_id].resched = 1;
+    p = p->blockedon ? p->blockedon->owner : 0;
+  }
+}
+
+// The current process is about to sleep until pi's owner hands
+// pi over to it.  Caller holds the lock's spinlock, and the lock
+// is held.
+void pi_block(struct pi *pi)
+{
+  struct proc *p = myproc();
+
+  acquire(&pilock);
+  if (pi->waiters == 0) {
+    pi->nextboost = pi->owner->boosts;
+    pi->owner->boosts = pi;
+  }
+  p->blockedon = pi;
+  p->piwnext = pi->waiters;
+  pi->waiters = p;
+  pi_chain(pi->owner);
+  release(&pilock);
+}
+
+// The owner lets go of pi: to, one of its waiters, owns it now,
+// or no one if to is 0 (only when there are no waiters).  The
+// old owner drops back to what its other locks leave it, and to
+// inherits from the waiters still queued.  Caller holds the
+// lock's spinlock.
+void pi_handoff(struct pi *pi, struct proc *to)
+{
+  struct proc *from, **pp;
+  struct pi **lp;
+
+  if (pi->waiters == 0) {
+    pi->owner = to;
+    return;
+  }
+
+  acquire(&pilock);
+  from = pi->owner;
+  for (lp = &from->boosts; *lp; lp = &(*lp)->nextboost) {
+    if (*lp == pi) {
+      *lp = pi->nextboost;
+      break;
+    }
+  }
+  for (pp = &pi->waiters; *pp; pp = &(*pp)->piwnext) {
+    if (*pp == to) {
+      *pp = to->piwnext;
+      break;
+    }
+  }
+  to->blockedon = 0;
+  to->piwnext = 0;
+  pi->owner = to;
+  if (pi->waiters) {
+    pi->nextboost = to->boosts;
+    to->boosts = pi;
+  }
+  pi_chain(from);
+  pi_chain(to);
+  release(&pilock);
+}
+
+// Set p's own priority, passing the change on to any owner it is
+// blocked behind.
+void pi_setprio(struct proc *p, int priority)
+{
+  acquire(&pilock);
+  p->priority = priority;
+  pi_chain(p);
+  release(&pilock);
+}
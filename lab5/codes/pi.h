@@ -0,0 +1,14 @@
+#ifndef _PI_H_
+#define _PI_H_
+
+// Priority inheritance state of a sleeping lock (sleeplock,
+// plock).  While a lock has waiters it is on its owner's list of
+// boosting locks, and the owner runs at the best priority of any
+// of their waiters.
+struct pi {
+  struct proc *owner;     // holder, or 0
+  struct proc *waiters;   // blocked acquirers, through proc->piwnext
+  struct pi *nextboost;   // next lock boosting owner
+};
+
+#endif
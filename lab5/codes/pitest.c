@@ -0,0 +1,142 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Priority inversion across a chain of two locks (lower
+// priority numbers run first):
+//
+//   low  (5) holds testlock and has CSTICKS of work to do in it;
+//   mid  (4) holds global_plock and blocks on testlock;
+//   hogs (3) keep every CPU busy for HOGTICKS;
+//   high (0) blocks on global_plock.
+//
+// Without inheritance, low never gets a CPU while the hogs run,
+// so high waits at least HOGTICKS.  With it, high's priority
+// passes through mid to low, which finishes its work ahead of
+// the hogs, and high's wait stays close to CSTICKS.
+//
+// pitest [hogs]; the default is enough for 8 CPUs.
+
+#define CSTICKS 20
+#define HOGTICKS 300
+#define NHOG 8
+
+int fd[2];
+
+void setprio(int prio)
+{
+  set_priority_syscall(getpid(), prio);
+}
+
+// Tell the parent we got this far.
+void signal(void)
+{
+  int x = 0;
+
+  write(fd[1], &x, sizeof(x));
+}
+
+void await(void)
+{
+  int x;
+
+  if (read(fd[0], &x, sizeof(x)) != sizeof(x))
+  {
+    printf(1, "pitest: lost a child\n");
+    exit();
+  }
+}
+
+void work(uint n)
+{
+  volatile uint i;
+
+  for (i = 0; i < n; i++)
+    ;
+}
+
+// Iterations of work() that take about CSTICKS.
+uint calibrate(void)
+{
+  uint n, t0;
+
+  t0 = uptime();
+  for (n = 0; uptime() - t0 < CSTICKS; n++)
+    work(100000);
+  return n * 100000;
+}
+
+int main(int argc, char *argv[])
+{
+  int nhog, i, blocked;
+  uint n, t0;
+
+  nhog = NHOG;
+  if (argc > 1)
+    nhog = atoi(argv[1]);
+  if (pipe(fd) < 0)
+  {
+    printf(1, "pitest: pipe failed\n");
+    exit();
+  }
+  setprio(0);
+  n = calibrate();
+  printf(1, "critical section: %d iterations, about %d ticks alone\n", n, CSTICKS);
+
+  if (fork() == 0)
+  {
+    setprio(5);
+    test_acquire();
+    signal();
+    work(n);
+    test_release();
+    exit();
+  }
+  await();
+
+  if (fork() == 0)
+  {
+    setprio(4);
+    plock_acquire(0);
+    signal();
+    test_acquire();
+    test_release();
+    plock_release();
+    exit();
+  }
+  await();
+  sleep(2); // for mid to block on testlock
+
+  for (i = 0; i < nhog; i++)
+  {
+    if (fork() == 0)
+    {
+      setprio(3);
+      t0 = uptime();
+      while (uptime() - t0 < HOGTICKS)
+        ;
+      exit();
+    }
+  }
+  sleep(2); // for the hogs to take over
+
+  if (fork() == 0)
+  {
+    setprio(0);
+    t0 = uptime();
+    plock_acquire(0);
+    blocked = uptime() - t0;
+    plock_release();
+    write(fd[1], &blocked, sizeof(blocked));
+    exit();
+  }
+  if (read(fd[0], &blocked, sizeof(blocked)) != sizeof(blocked))
+    blocked = -1;
+  for (i = 0; i < nhog + 3; i++)
+    wait();
+
+  printf(1, "high priority blocked %d ticks behind a %d-tick critical section", blocked, CSTICKS);
+  printf(1, " and %d hogs of %d ticks: %s\n", nhog, HOGTICKS,
+         blocked >= 0 && blocked <= 2 * CSTICKS + 10 ? "bounded" : "FAILED");
+  exit();
+}
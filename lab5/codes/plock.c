@@ -1,3 +1,14 @@
+// Priority locks: sleeping locks that go to the highest-priority
+// waiter, and to the one that has waited longest among equals.
+//
+// Waiters sit in a binary heap in the lock, keyed by priority and
+// then arrival number, so a release finds the next owner in
+// O(log n) instead of scanning every waiter.  The wait node is on
+// the waiter's kernel stack, and release makes it the owner
+// before waking it, so it never competes for the lock again.
+// Only its owner touches a process's list of held plocks, except
+// to add one while it sleeps waiting for it.
+
 #include "types.h"
 #include "defs.h"
 #include "param.h"
@@ -6,6 +17,17 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "plock.h"
+
+// A waiting process, on its own kernel stack.
+struct plockwait
+{
+    struct proc *proc;
+    int priority;
+    uint seq;      // arrival number, to keep equal priorities FIFO
+    uint64 t0;     // rdtsc() when it started to wait
+    int granted;   // set by plock_release() when the lock is ours
+};
 
 struct plock global_plock;
 
@@ -14,90 +36,173 @@ void plock_init(struct plock *pl, char *name)
     initlock(&pl->lk, "plock_internal");
     pl->name = name;
     pl->locked = 0;
-    // pl->owner = 0; 
-    pl->head = 0;
+    pi_init(&pl->pi);
+    pl->seq = 0;
+    pl->nwait = 0;
+    pl->nextheld = 0;
+    memset(&pl->stat, 0, sizeof(pl->stat));
 }
 
-void plock_acquire(struct plock *pl, int priority)
+static int band(int priority)
 {
-    acquire(&pl->lk);
+    if (priority < 0)
+        return 0;
+    if (priority >= NPLBAND * PLBANDSIZE)
+        return NPLBAND - 1;
+    return priority / PLBANDSIZE;
+}
 
-    if (pl->locked == 0)
-    {
-        pl->locked = 1;
-        // pl->owner = myproc();
-        release(&pl->lk);
-    }
-    else
-    {
-        struct plock_node *node = (struct plock_node *)kalloc();
-        node->proc = myproc();
-        node->priority = priority;
-        node->next = pl->head;
-        pl->head = node;
-        sleep(node, &pl->lk);
+// Should a be served before b?
+static int before(struct plockwait *a, struct plockwait *b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return (int)(a->seq - b->seq) < 0;
+}
 
-        // pl->owner = myproc();
+static void heap_push(struct plock *pl, struct plockwait *w)
+{
+    struct plockwait **h = pl->heap;
+    int i, up;
 
-        kfree((char *)node);
-        release(&pl->lk);
+    for (i = pl->nwait++; i > 0; i = up)
+    {
+        up = (i - 1) / 2;
+        if (!before(w, h[up]))
+            break;
+        h[i] = h[up];
     }
+    h[i] = w;
 }
-static struct plock_node *plock_pop_max(struct plock *pl)
-{
-    if (pl->head == 0)
-        return 0;
 
-    struct plock_node *curr = pl->head;
-    struct plock_node *max_node = curr;
-    struct plock_node *prev = 0;
-    struct plock_node *prev_of_max = 0;
+static struct plockwait *heap_pop(struct plock *pl)
+{
+    struct plockwait **h = pl->heap;
+    struct plockwait *top, *last;
+    int i, down;
 
-    while (curr != 0)
+    top = h[0];
+    last = h[--pl->nwait];
+    for (i = 0; (down = 2 * i + 1) < pl->nwait; i = down)
     {
-        if (curr->priority > max_node->priority)
-        {
-            max_node = curr;
-            prev_of_max = prev;
-        }
-        prev = curr;
-        curr = curr->next;
+        if (down + 1 < pl->nwait && before(h[down + 1], h[down]))
+            down++;
+        if (!before(h[down], last))
+            break;
+        h[i] = h[down];
     }
+    h[i] = last;
+    return top;
+}
 
-    if (prev_of_max == 0)
+// Make p the owner, having waited since t0 (0 if it did not
+// wait).  Caller holds pl->lk.
+static void grant(struct plock *pl, struct proc *p, int priority, uint64 t0, uint64 now)
+{
+    int b = band(priority);
+
+    pl->locked = 1;
+    pl->pi.owner = p;
+    pl->nextheld = p->plocks;
+    p->plocks = pl;
+    pl->prio = priority;
+    pl->tgrant = now;
+    pl->stat.band[b].acq++;
+    if (t0)
     {
-        pl->head = max_node->next;
+        pl->stat.band[b].waited++;
+        pl->stat.band[b].wait += now - t0;
+        if (now - t0 > pl->stat.band[b].maxwait)
+            pl->stat.band[b].maxwait = now - t0;
     }
-    else
+}
+
+void plock_acquire(struct plock *pl, int priority)
+{
+    struct plockwait w;
+    uint64 t0;
+
+    t0 = rdtsc();
+    acquire(&pl->lk);
+
+    if (pl->locked == 0)
     {
-        prev_of_max->next = max_node->next;
+        grant(pl, myproc(), priority, 0, rdtsc());
+        release(&pl->lk);
+        return;
     }
 
-    max_node->next = 0;
-
-    return max_node;
+    if (pl->nwait == NPROC)
+        panic("plock_acquire: heap full");
+    w.proc = myproc();
+    w.priority = priority;
+    w.seq = pl->seq++;
+    w.t0 = t0;
+    w.granted = 0;
+    heap_push(pl, &w);
+    pi_block(&pl->pi);
+    // plock_release() hands the lock over, so there is nothing
+    // to retry once woken.
+    while (!w.granted)
+        sleep(&w, &pl->lk);
+    release(&pl->lk);
 }
 
-void plock_release(struct plock *pl)
+// Returns -1 if the caller does not hold pl.
+int plock_release(struct plock *pl)
 {
+    struct plockwait *w;
+    struct plock **pp;
+    uint64 now;
+
     acquire(&pl->lk);
 
-    // if (pl->owner != myproc()) {
-        // panic("plock_release: not owner");
-    // }   
+    if (!pl->locked || pl->pi.owner != myproc())
+    {
+        release(&pl->lk);
+        return -1;
+    }
+
+    for (pp = &myproc()->plocks; *pp != pl; pp = &(*pp)->nextheld)
+        ;
+    *pp = pl->nextheld;
 
-    struct plock_node *winner = plock_pop_max(pl);
+    now = rdtsc();
+    pl->stat.band[band(pl->prio)].hold += now - pl->tgrant;
 
-    if (winner != 0)
+    if (pl->nwait > 0)
     {
-        wakeup(winner);
-        // pl->owner = winner->proc;
-        // pl->owner = 0;
+        w = heap_pop(pl);
+        pi_handoff(&pl->pi, w->proc);
+        grant(pl, w->proc, w->priority, w->t0, now);
+        w->granted = 1;
+        wakeup(w);
     }
     else
     {
         pl->locked = 0;
+        pi_handoff(&pl->pi, 0);
     }
 
     release(&pl->lk);
-}
\ No newline at end of file
+    return 0;
+}
+
+// p, the current process, is exiting: release every plock it
+// still holds, so that none is left with a dead owner.
+void plock_exit(struct proc *p)
+{
+    while (p->plocks)
+        plock_release(p->plocks);
+}
+
+// Copy out pl's statistics, then zero them if reset is set.
+void plock_stat(struct plock *pl, struct plockstat *ps, int reset)
+{
+    acquire(&pl->lk);
+    *ps = pl->stat;
+    ps->nwait = pl->nwait;
+    if (reset)
+        memset(&pl->stat, 0, sizeof(pl->stat));
+    release(&pl->lk);
+}
@@ -0,0 +1,32 @@
+#ifndef _PLOCK_H_
+#define _PLOCK_H_
+
+#include "spinlock.h"
+#include "plockstat.h"
+#include "pi.h"
+
+struct plockwait;
+
+// Sleeping lock granted by priority.  Waiters are kept in a
+// binary heap, highest priority first and, among equals, in the
+// order they arrived; release hands the lock straight to the
+// top one.  A process waits for one lock at a time, so NPROC
+// heap slots always suffice.  The owner inherits the best
+// scheduling priority among the waiters (pi.c), which is apart
+// from the priority they queue with.  Each process keeps a list
+// of the plocks it holds, so that exit() can let them go.
+struct plock {
+  struct spinlock lk;
+  int locked;
+  struct pi pi;                  // owner, and its priority inheritance
+  int prio;                      // priority the owner asked with
+  uint64 tgrant;                 // rdtsc() when the owner got it
+  uint seq;                      // arrival number for the next waiter
+  int nwait;
+  struct plockwait *heap[NPROC]; // heap[0] is served next
+  struct plockstat stat;
+  char *name;
+  struct plock *nextheld;        // next lock on the owner's proc->plocks
+};
+
+#endif
@@ -0,0 +1,14 @@
+// Priority lock statistics, see plockstat().
+#define NPLBAND    4   // priority bands statistics are kept for
+#define PLBANDSIZE 16  // priorities per band; the last takes all above
+
+struct plockstat {
+  int nwait;            // processes waiting right now
+  struct {
+    uint acq;           // acquisitions at priorities in this band
+    uint waited;        // of which had to wait
+    uint64 wait;        // cycles spent waiting
+    uint64 maxwait;     // longest single wait
+    uint64 hold;        // cycles the lock was held
+  } band[NPLBAND];
+};
@@ -1,50 +1,174 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "plockstat.h"
 
-void child_worker(int priority)
-{
-    printf(1, "Child %d requesting lock with priority %d\n", getpid(), priority);
-
-    plock_acquire(priority);
+// Priority lock benchmark, in two parts, and a check that a
+// process exiting with the lock held gives it up.
+//
+// Order: the parent holds the lock while nproc children queue
+// behind it one at a time, with priorities that repeat so some
+// are equal.  Once the parent lets go, the lock must pass to
+// them highest priority first and, among equals, in the order
+// they queued.
+//
+// Load: nproc children each take and release the lock rounds
+// times at their own priority, and the kernel's statistics give
+// the waits and hold times per priority band.  Cycles are in
+// thousands.
+//
+// plocktest [nproc [rounds]]; every child is a process, so nproc
+// is bounded by NPROC less the few already running.
 
-    printf(1, "Child %d ACQUIRED lock with priority %d\n", getpid(), priority);
+#define MAXWORKER 60
+#define NPRIO (NPLBAND * PLBANDSIZE)
 
-    sleep(100);
+struct plockstat ps;
 
-    plock_release();
-    exit();
+// Child i's priority; every value is used by a few children.
+int prio(int i)
+{
+    return (i * 37) % NPRIO / 4 * 4;
 }
 
-int main(int argc, char *argv[])
+void order(int nproc)
 {
-    printf(1, "Starting Test\n");
+    int fd[2], got[MAXWORKER], i, n, bad, pid;
+
+    if (pipe(fd) < 0)
+    {
+        printf(1, "plocktest: pipe failed\n");
+        exit();
+    }
+    plock_acquire(NPRIO);
+    for (i = 0; i < nproc; i++)
+    {
+        if ((pid = fork()) < 0)
+        {
+            printf(1, "plocktest: fork failed after %d\n", i);
+            nproc = i;
+            break;
+        }
+        if (pid == 0)
+        {
+            close(fd[0]);
+            plock_acquire(prio(i));
+            write(fd[1], &i, sizeof(i));
+            plock_release();
+            exit();
+        }
+        // Let it queue before the next one, so arrival order is i.
+        for (;;)
+        {
+            plockstat(&ps, 0);
+            if (ps.nwait > i)
+                break;
+            sleep(1);
+        }
+    }
+    close(fd[1]);
+    plock_release();
+
+    for (n = 0; n < nproc && read(fd[0], &got[n], sizeof(got[n])) == sizeof(got[n]); n++)
+        ;
+    close(fd[0]);
+    for (i = 0; i < nproc; i++)
+        wait();
 
-    int parent_prio = 10;
-    printf(1, "Parent acquiring lock with Priority %d\n", parent_prio);
-    plock_acquire(parent_prio);
+    bad = 0;
+    for (i = 1; i < n; i++)
+        if (prio(got[i]) > prio(got[i - 1]) ||
+            (prio(got[i]) == prio(got[i - 1]) && got[i] < got[i - 1]))
+            bad++;
+    printf(1, "order: %d waiters served, %d out of order%s\n", n, bad,
+           n == nproc && bad == 0 ? "" : " FAILED");
+}
 
-    int priorities[] = {20, 50, 30, 40};
-    int n = 4;
+void load(int nproc, int rounds)
+{
+    int i, r, b, lo, pid;
+    uint t0, t1;
+    volatile int x;
 
-    for (int i = 0; i < n; i++)
+    plockstat(&ps, 1);
+    t0 = uptime();
+    for (i = 0; i < nproc; i++)
     {
-        int pid = fork();
+        if ((pid = fork()) < 0)
+        {
+            printf(1, "plocktest: fork failed after %d\n", i);
+            nproc = i;
+            break;
+        }
         if (pid == 0)
         {
-            child_worker(priorities[i]);
+            for (r = 0; r < rounds; r++)
+            {
+                plock_acquire(prio(i));
+                for (x = 0; x < 1000; x++)
+                    ;
+                plock_release();
+            }
+            exit();
         }
-        sleep(10);
     }
+    for (i = 0; i < nproc; i++)
+        wait();
+    t1 = uptime();
+    plockstat(&ps, 0);
 
-    sleep(100);
+    printf(1, "load: %d workers x %d rounds in %d ticks\n", nproc, rounds, t1 - t0);
+    printf(1, "prio\tacq\twaited\tavgwait\tmaxwait\tavghold\n");
+    for (b = 0; b < NPLBAND; b++)
+    {
+        lo = b * PLBANDSIZE;
+        printf(1, "%d-%d%s\t%d\t%d\t%d\t%d\t%d\n", lo, lo + PLBANDSIZE - 1,
+               b == NPLBAND - 1 ? "+" : "", ps.band[b].acq, ps.band[b].waited,
+               ps.band[b].waited ? (uint)(ps.band[b].wait >> 10) / ps.band[b].waited : 0,
+               (uint)(ps.band[b].maxwait >> 10),
+               ps.band[b].acq ? (uint)(ps.band[b].hold >> 10) / ps.band[b].acq : 0);
+    }
+}
 
-    plock_release();
+// The child dies holding the lock; if exit() did not release it,
+// the parent would wait for it forever.
+void orphan(void)
+{
+    int pid;
 
-    for (int i = 0; i < n; i++)
+    if ((pid = fork()) < 0)
     {
-        wait();
+        printf(1, "plocktest: fork failed\n");
+        return;
     }
+    if (pid == 0)
+    {
+        plock_acquire(0);
+        exit();
+    }
+    wait();
+    plock_acquire(0);
+    printf(1, "exit: lock released by its exiting owner%s\n", plock_release() < 0 ? " FAILED" : "");
+}
+
+int main(int argc, char *argv[])
+{
+    int nproc, rounds;
 
+    nproc = 48;
+    rounds = 20;
+    if (argc > 1)
+        nproc = atoi(argv[1]);
+    if (argc > 2)
+        rounds = atoi(argv[2]);
+    if (nproc < 1 || nproc > MAXWORKER || rounds < 1)
+    {
+        printf(1, "usage: plocktest [nproc [rounds]]\n");
+        exit();
+    }
+
+    order(nproc);
+    load(nproc, rounds);
+    orphan();
     exit();
-}
\ No newline at end of file
+}
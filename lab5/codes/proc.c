@@ -6,11 +6,20 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "seqlock.h"
+#include "percpu.h"
+#include "frame.h"
+#include "memstat.h"
+
+#define NPIDHASH 64
+#define PIDHASH(pid) ((uint)(pid) % NPIDHASH)
 
 struct
 {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *pidhash[NPIDHASH]; // live processes by pid, read under RCU
+  int nreaping;                   // reaped slots waiting for a grace period
 } ptable;
 
 static struct proc *initproc;
@@ -22,6 +31,47 @@ extern uint ticks;
 
 static void wakeup1(void *chan);
 
+int is_movable(struct proc *p);
+
+// What each CPU's run queue looks like, for placement and load
+// balancing to read without ptable.lock.  Updated with the queue,
+// so writers already hold ptable.lock and the seqlock only has to
+// keep readers from seeing one field new and the other old.
+struct cpuload {
+  struct seqlock seq;
+  int nrun;       // processes on the run queue
+  int nmovable;   // of which is_movable()
+};
+static DEFINE_PERCPU(struct cpuload, cpuloads);
+
+// Account for p joining (delta 1) or leaving (-1) c's run queue.
+// Caller holds ptable.lock.
+static void loadnote(struct cpu *c, struct proc *p, int delta)
+{
+  struct cpuload *l = &per_cpu(cpuloads, c - cpus);
+
+  write_seqbegin(&l->seq);
+  l->nrun += delta;
+  if (is_movable(p))
+    l->nmovable += delta;
+  write_seqend(&l->seq);
+}
+
+// A consistent snapshot of CPU i's load; may be stale by the time
+// it is used unless the caller holds ptable.lock.
+static void cpu_load(int i, int *nrun, int *nmovable)
+{
+  struct cpuload *l = &per_cpu(cpuloads, i);
+  uint s;
+
+  do
+  {
+    s = read_seqbegin(&l->seq);
+    *nrun = l->nrun;
+    *nmovable = l->nmovable;
+  } while (read_seqretry(&l->seq, s));
+}
+
 void push_back(struct cpu *c, struct proc *p)
 {
   if (p->state != RUNNABLE)
@@ -39,6 +89,10 @@ void push_back(struct cpu *c, struct proc *p)
       curr = curr->next;
     curr->next = p;
   }
+  p->cpu_id = c - cpus;
+  loadnote(c, p, 1);
+  if (c->proc && p->effprio < c->proc->effprio)
+    c->resched = 1;
 }
 
 struct proc *
@@ -49,20 +103,68 @@ pop_front(struct cpu *c)
   {
     c->runq = p->next;
     p->next = 0;
+    loadnote(c, p, -1);
   }
   return p;
 }
 
 int cpu_get_load(struct cpu *c)
 {
-  int count = 0;
-  struct proc *p = c->runq;
-  while (p)
+  int nrun, nmovable;
+
+  cpu_load(c - cpus, &nrun, &nmovable);
+  return nrun;
+}
+
+// The least loaded of the CPUs whose index has the given parity.
+static struct cpu *least_loaded(int parity, int *load)
+{
+  struct cpu *best = 0;
+  int i, n;
+
+  *load = 1000000;
+  for (i = 0; i < ncpu; i++)
   {
-    count++;
-    p = p->next;
+    if (i % 2 == parity)
+    {
+      n = cpu_get_load(&cpus[i]);
+      if (n < *load)
+      {
+        *load = n;
+        best = &cpus[i];
+      }
+    }
   }
-  return count;
+  return best;
+}
+
+// Take the process c should run next off its queue: the best
+// effective priority and, among equals, the first queued (round
+// robin on even CPUs) or the oldest (FCFS on odd ones).
+// Caller holds ptable.lock.
+static struct proc *pick(struct cpu *c)
+{
+  struct proc *p, *prev, *best, *bestprev;
+
+  best = bestprev = 0;
+  for (prev = 0, p = c->runq; p; prev = p, p = p->next)
+  {
+    if (best == 0 || p->effprio < best->effprio ||
+        (p->effprio == best->effprio && cpuid() % 2 != 0 && p->ctime < best->ctime))
+    {
+      best = p;
+      bestprev = prev;
+    }
+  }
+  if (best == 0)
+    return 0;
+  if (bestprev == 0)
+    c->runq = best->next;
+  else
+    bestprev->next = best->next;
+  best->next = 0;
+  loadnote(c, best, -1);
+  return best;
 }
 
 int is_movable(struct proc *p)
@@ -81,36 +183,23 @@ int is_movable(struct proc *p)
 void balance_load(void)
 {
   struct cpu *c = mycpu();
+  int my_load, movable, min_load;
+  struct cpu *target_cpu;
 
   if (cpuid() % 2 != 0)
     return;
 
-  acquire(&ptable.lock);
-
-  int my_load = cpu_get_load(c);
-
-  int min_load = 1000000;
-  struct cpu *target_cpu = 0;
-  int i;
+  // Most ticks there is nothing to move; find that out from the
+  // snapshots and leave ptable.lock alone.
+  cpu_load(cpuid(), &my_load, &movable);
+  target_cpu = least_loaded(1, &min_load);
+  if (target_cpu == 0 || movable == 0 || my_load < min_load + 3)
+    return;
 
-  for (i = 0; i < ncpu; i++)
-  {
-    if (i % 2 != 0)
-    {
-      int load = cpu_get_load(&cpus[i]);
-      if (load < min_load)
-      {
-        min_load = load;
-        target_cpu = &cpus[i];
-      }
-    }
-  }
+  acquire(&ptable.lock);
 
-  if (target_cpu == 0)
-  {
-    release(&ptable.lock);
-    return;
-  }
+  my_load = cpu_get_load(c);
+  min_load = cpu_get_load(target_cpu);
 
   if (my_load >= min_load + 3)
   {
@@ -140,6 +229,7 @@ void balance_load(void)
         prev->next = victim->next;
       }
       victim->next = 0;
+      loadnote(c, victim, -1);
 
       victim->cpu_id = target_cpu - cpus;
 
@@ -155,51 +245,111 @@ void balance_load(void)
 
 void pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
-  initlock(&central_ptable.lock, "central_ptable");
+  int i;
+
+  initlock_type(&ptable.lock, "ptable", LOCK_MCS);
+  for (i = 0; i < NCPU; i++)
+    initseqlock(&per_cpu(cpuloads, i).seq, "cpuload");
 }
 
 // Must be called with interrupts disabled
 int cpuid()
 {
-  return mycpu() - cpus;
+  int id;
+
+  // volatile: a process may be on another CPU after a swtch().
+  asm volatile("movl %%gs:%c1, %0" : "=r"(id)
+               : "i"(__builtin_offsetof(struct cpu, id)));
+  return id;
 }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled and then using another CPU's struct cpu.
 struct cpu *
 mycpu(void)
 {
-  int apicid, i;
+  struct cpu *c;
 
   if (readeflags() & FL_IF)
     panic("mycpu called with interrupts enabled\n");
 
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i)
-  {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
+  asm volatile("movl %%gs:%c1, %0" : "=r"(c)
+               : "i"(__builtin_offsetof(struct cpu, self)));
+  return c;
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// A single load, so no interrupt can move us to another CPU
+// halfway through; and whichever CPU it ran on, that CPU's
+// current process is us.
 struct proc *
 myproc(void)
 {
-  struct cpu *c;
   struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
+
+  asm volatile("movl %%gs:%c1, %0" : "=r"(p)
+               : "i"(__builtin_offsetof(struct cpu, proc)));
   return p;
 }
 
+// Make p findable by pid.  Caller holds ptable.lock.  p is
+// filled in before it is linked, and x86 keeps the stores in
+// that order, so a lock-free reader never sees it half made.
+static void pidhash_insert(struct proc *p)
+{
+  struct proc **h = &ptable.pidhash[PIDHASH(p->pid)];
+
+  p->pidnext = *h;
+  __asm__ volatile("" ::: "memory");
+  *h = p;
+}
+
+// Unlink p from its chain.  p->pidnext is left alone so that a
+// reader standing on p still finds the rest of the chain.
+// Caller holds ptable.lock.
+static void pidhash_remove(struct proc *p)
+{
+  struct proc **pp;
+
+  for (pp = &ptable.pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->pidnext)
+  {
+    if (*pp == p)
+    {
+      *pp = p->pidnext;
+      return;
+    }
+  }
+}
+
+// The process with the given pid, or 0.  Caller is inside
+// rcu_read_lock() or holds ptable.lock.  The process may exit
+// and be reaped meanwhile, but its slot is not reused before
+// the read section ends.
+struct proc *
+findproc(int pid)
+{
+  struct proc *p;
+
+  for (p = ptable.pidhash[PIDHASH(pid)]; p; p = p->pidnext)
+    if (p->pid == pid)
+      return p;
+  return 0;
+}
+
+// A grace period has passed since wait() reaped p, so no lookup
+// can still be using it: give the slot back to allocproc().
+static void procfree(struct rcu_head *h)
+{
+  struct proc *p = (struct proc *)((char *)h - (uint)&((struct proc *)0)->rcu);
+
+  acquire(&ptable.lock);
+  p->pid = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+  ptable.nreaping--;
+  release(&ptable.lock);
+}
+
 // PAGEBREAK: 32
 //  Look in the process table for an UNUSED proc.
 //  If found, change state to EMBRYO and initialize
@@ -213,10 +363,19 @@ allocproc(void)
 
   acquire(&ptable.lock);
 
+retry:
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if (p->state == UNUSED)
       goto found;
 
+  // Reaped processes hand their slots back after a grace period.
+  if (ptable.nreaping > 0 && myproc())
+  {
+    release(&ptable.lock);
+    synchronize_rcu();
+    acquire(&ptable.lock);
+    goto retry;
+  }
   release(&ptable.lock);
   return 0;
 
@@ -225,9 +384,21 @@ found:
   p->pid = nextpid++;
 
   p->priority = 1;
+  p->effprio = 1;
+  p->blockedon = 0;
+  p->piwnext = 0;
+  p->boosts = 0;
+  p->plocks = 0;
   p->ticks_consumed = 0;
   p->ctime = ticks;
   p->finished_count = 0;
+  p->npin = 0;
+  p->minflt = p->majflt = p->lastmaj = 0;
+  p->pff = p->wss = 0;
+  p->thrashing = 0;
+  memset(p->seq, 0, sizeof(p->seq));
+  p->seqnext = 0;
+  p->shm = 0;
 
   release(&ptable.lock);
 
@@ -269,6 +440,7 @@ void userinit(void)
   if ((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  frame_setpid(p->pgdir, p->pid);
   p->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
@@ -282,6 +454,13 @@ void userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
+  // Place it from the load snapshots before taking the lock;
+  // a queue that changes meanwhile only makes the choice stale.
+  int min_load;
+  struct cpu *best_cpu = least_loaded(0, &min_load);
+  if (best_cpu == 0)
+    best_cpu = &cpus[0];
+
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
@@ -289,23 +468,8 @@ void userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
+  pidhash_insert(p);
 
-  int min_load = 1000000;
-  struct cpu *best_cpu = &cpus[0];
-  int i;
-
-  for (i = 0; i < ncpu; i++)
-  {
-    if (i % 2 == 0)
-    {
-      int load = cpu_get_load(&cpus[i]);
-      if (load < min_load)
-      {
-        min_load = load;
-        best_cpu = &cpus[i];
-      }
-    }
-  }
   p->cpu_id = best_cpu - cpus;
   // cprintf("userinit: PID %d assigned to E-core %d (Load: %d)\n", p->pid, best_cpu - cpus, min_load);
   push_back(best_cpu, p);
@@ -331,8 +495,10 @@ int growproc(int n)
     if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
+  // No switchuvm(): growing only fills in PTEs that were not
+  // present, which the TLB never caches, and deallocuvm() has
+  // already invalidated whatever it unmapped.
   curproc->sz = sz;
-  switchuvm(curproc);
   return 0;
 }
 
@@ -351,15 +517,21 @@ int fork(void)
     return -1;
   }
 
-  // Copy process state from proc.
-  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0)
+  // Copy process state from proc; shared memory is mapped, not copied.
+  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0 ||
+      shm_dup(np, curproc->shm) < 0)
   {
+    if (np->pgdir)
+      freevm(np->pgdir);
+    np->pgdir = 0;
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
+  frame_setpid(np->pgdir, np->pid);
   np->sz = curproc->sz;
+  memmove(np->seq, curproc->seq, sizeof(np->seq));
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -375,26 +547,18 @@ int fork(void)
 
   pid = np->pid;
 
+  // Place it from the load snapshots before taking the lock;
+  // a queue that changes meanwhile only makes the choice stale.
+  int min_load;
+  struct cpu *best_cpu = least_loaded(0, &min_load);
+  if (best_cpu == 0)
+    best_cpu = &cpus[0];
+
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
+  pidhash_insert(np);
 
-  int min_load = 1000000;
-  struct cpu *best_cpu = &cpus[0];
-  // int i;
-
-  for (i = 0; i < ncpu; i++)
-  {
-    if (i % 2 == 0)
-    {
-      int load = cpu_get_load(&cpus[i]);
-      if (load < min_load)
-      {
-        min_load = load;
-        best_cpu = &cpus[i];
-      }
-    }
-  }
   np->cpu_id = best_cpu - cpus;
   // cprintf("fork: PID %d assigned to E-core %d (Load: %d)\n", np->pid, best_cpu-cpus, min_load);
   push_back(best_cpu, np);
@@ -416,6 +580,9 @@ void exit(void)
   if (curproc == initproc)
     panic("init exiting");
 
+  // Hand any priority locks still held to their next waiters.
+  plock_exit(curproc);
+
   // Close all open files.
   for (fd = 0; fd < NOFILE; fd++)
   {
@@ -449,17 +616,6 @@ void exit(void)
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
-/////////////////qwer
-  acquire(&central_ptable.lock);
-  for (int i = 0; i < 4; i++)
-  {
-    if (central_ptable.entries[i].pid == curproc->pid)
-    {
-      central_ptable.entries[i].valid = 0;
-    }
-  }
-  release(&central_ptable.lock);
-//////////////////qwer
   sched();
   panic("zombie exit");
 }
@@ -489,15 +645,19 @@ int wait(void)
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
-        p->pid = 0;
+        p->pgdir = 0;
+        shm_put(p->shm);
+        p->shm = 0;
         p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
         if (curproc->throughput_state == 1)
         {
           curproc->finished_count++;
         }
-        p->state = UNUSED;
+        // Lock-free lookups may have found p already; it stays
+        // a zombie until they are done.
+        pidhash_remove(p);
+        ptable.nreaping++;
+        call_rcu(&p->rcu, procfree);
         release(&ptable.lock);
         return pid;
       }
@@ -542,54 +702,8 @@ void scheduler(void)
 
     acquire(&ptable.lock);
 
-    if (cpuid() % 2 == 0)
-    {
-      p = pop_front(c);
-      // if (p)
-      // {
-      //   cprintf("CPU %d (RR): Picked PID %d\n", cpuid_val, p->pid);
-      // }
-    }
-    else
-    {
-      struct proc *min_p = 0;
-      struct proc *curr = c->runq;
-      struct proc *prev = 0;
-      struct proc *min_prev = 0;
-
-      // if (curr)
-      // {
-      //   cprintf("CPU %d (FCFS): Queue not empty, searching...\n", cpuid_val);
-      // }
-
-      while (curr)
-      {
-        if (min_p == 0 || curr->ctime < min_p->ctime)
-        {
-          min_p = curr;
-          min_prev = prev;
-        }
-        prev = curr;
-        curr = curr->next;
-      }
-
-      p = min_p;
-
-      if (p)
-      {
-        // cprintf("CPU %d (FCFS): Found PID %d with ctime %d\n", cpuid_val, p->pid, p->ctime);
-
-        if (min_prev == 0)
-        {
-          c->runq = p->next;
-        }
-        else
-        {
-          min_prev->next = p->next;
-        }
-        p->next = 0;
-      }
-    }
+    p = pick(c);
+    c->resched = 0;
 
     if (p != 0)
     {
@@ -605,8 +719,14 @@ void scheduler(void)
     }
 
     release(&ptable.lock);
-
-    if (p == 0)
+    // Whatever ran here has switched out: a quiescent state.
+    rcu_quiescent();
+    memtick();
+
+    // Nothing to run: zero a free page for kalloc_zeroed()
+    // or look for pages to merge if there is work to do,
+    // otherwise wait for an interrupt.
+    if (p == 0 && !kzero_idle() && !ksmscan())
     {
       sti();
       hlt();
@@ -665,6 +785,7 @@ void forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -745,25 +866,30 @@ int kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  rcu_read_lock();
+  if ((p = findproc(pid)) == 0)
   {
-    if (p->pid == pid)
+    rcu_read_unlock();
+    return -1;
+  }
+  p->killed = 1;
+  // Wake process from sleep if necessary.  The fence keeps the
+  // load of state after the store to killed, so a process going
+  // to sleep either sees killed or is seen sleeping here.
+  __sync_synchronize();
+  if (p->state == SLEEPING)
+  {
+    acquire(&ptable.lock);
+    if (p->state == SLEEPING)
     {
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if (p->state == SLEEPING)
-      {
-        p->state = RUNNABLE;
-        int cpu_idx = p->pid % ncpu;
-        push_back(&cpus[cpu_idx], p);
-      }
-      release(&ptable.lock);
-      return 0;
+      p->state = RUNNABLE;
+      int cpu_idx = p->pid % ncpu;
+      push_back(&cpus[cpu_idx], p);
     }
+    release(&ptable.lock);
   }
-  release(&ptable.lock);
-  return -1;
+  rcu_read_unlock();
+  return 0;
 }
 
 // PAGEBREAK: 36
@@ -812,25 +938,22 @@ int show_process_family(int pid)
   int found_children = 0;
   int found_siblings = 0;
 
-  acquire(&ptable.lock);
+  // Only reads, and a stale family tree is fine for printing.
+  rcu_read_lock();
 
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if ((p = findproc(pid)) != 0 && p->state != UNUSED)
   {
-    if (p->pid == pid && p->state != UNUSED)
+    target_proc = p;
+    if (p->parent)
     {
-      target_proc = p;
-      if (p->parent)
-      {
-        parent_proc = p->parent;
-        parent_pid = p->parent->pid;
-      }
-      break;
+      parent_proc = p->parent;
+      parent_pid = p->parent->pid;
     }
   }
 
   if (target_proc == 0)
   {
-    release(&ptable.lock);
+    rcu_read_unlock();
     cprintf("PID is not valid\n");
     return -1;
   }
@@ -875,7 +998,7 @@ int show_process_family(int pid)
     cprintf("(No siblings found)\n");
   }
 
-  release(&ptable.lock);
+  rcu_read_unlock();
   return 0;
 }
 
@@ -887,17 +1010,14 @@ int sys_set_priority_syscall(void)
   if (argint(0, &pid) < 0 || argint(1, &priority) < 0)
     return -1;
 
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  rcu_read_lock();
+  if ((p = findproc(pid)) != 0)
   {
-    if (p->pid == pid)
-    {
-      p->priority = priority;
-      release(&ptable.lock);
-      return 0;
-    }
+    pi_setprio(p, priority);
+    rcu_read_unlock();
+    return 0;
   }
-  release(&ptable.lock);
+  rcu_read_unlock();
 
   cprintf("set_priority: PID %d not found\n", pid);
   return -1;
@@ -993,4 +1113,262 @@ void print_process_info(void)
   }
 
   cprintf("----------------------------------------------------\n\n");
-}
\ No newline at end of file
+}
+
+// Read or write the int at user address addr on behalf of
+// sys_read_page/sys_write_page.  The frame table finds the page
+// (argptr() has already brought it back if it was in swap) and
+// the replacement policy is told it was referenced.
+int handle_paging_request(char *addr, int value, int is_write)
+{
+  struct proc *curproc = myproc();
+  struct frame *f;
+  int *ip;
+
+  if ((f = frame_lookup(curproc->pgdir, (uint)addr)) == 0)
+    return -1;
+  frame_access(f);
+
+  ip = (int *)(P2V(FRAME2PA(f)) + (uint)addr % PGSIZE);
+  if (is_write)
+  {
+    // The CPU does not see writes through the kernel's mapping;
+    // without PTE_D, eviction would keep a stale copy in swap.
+    *walkpgdir(curproc->pgdir, addr, 0) |= PTE_D;
+    *ip = value;
+    return 0;
+  }
+  return *ip;
+}
+
+// Resident pages per process, then the replacement and swap
+// counters.
+void print_paging_stats(void)
+{
+  struct proc *p;
+
+  cprintf("\npid \t pages \t name\n");
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    if (p->state == UNUSED || p->state == ZOMBIE || p->pgdir == 0)
+      continue;
+    cprintf("%d \t %d \t %s\n", p->pid, frame_count(p->pgdir), p->name);
+  }
+  release(&ptable.lock);
+  framedump();
+  swapdump();
+  zramdump();
+  ksmdump();
+}
+
+// The live process whose page table is pgdir, or 0.
+// Caller holds ptable.lock.
+static struct proc *pgdirproc(pde_t *pgdir)
+{
+  static struct proc *last;
+  struct proc *p;
+
+  // Consecutive lookups usually ask about the same process.
+  if (last && last->pgdir == pgdir && last->state != UNUSED)
+    return last;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (p->pgdir == pgdir && p->state != UNUSED)
+      return last = p;
+  return 0;
+}
+
+// Would evicting f now be safe?  Called by the replacement
+// policy from swapout(), with ptable.lock held.  The page must
+// belong to a process that is sleeping or runnable, so no other
+// CPU can have it in its TLB, or to the caller's own process;
+// and it must not be pinned by the current system call.
+static int evictable(struct frame *f)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint va;
+  int i;
+
+  if ((p = pgdirproc(f->pgdir)) == 0)
+    return 0; // an exec or fork still building it
+  if (p->state != SLEEPING && p->state != RUNNABLE && p != myproc())
+    return 0;
+  va = FRAMEVA(f);
+  for (i = 0; i < p->npin; i++)
+    if (va < p->pin[i].hi && va + PGSIZE > p->pin[i].lo)
+      return 0;
+  pte = walkpgdir(f->pgdir, (char *)va, 0);
+  return pte && (*pte & (PTE_P | PTE_U)) == (PTE_P | PTE_U);
+}
+
+// Called by memtick() every WSINTERVAL ticks.  Estimates each
+// process's working set from the references frame_sample() has
+// seen, and has the page-fault-frequency controller mark those
+// faulting to disk hard enough to be thrashing; swapfault() then
+// holds them back.
+void memsample(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    if (p->state == UNUSED || p->state == EMBRYO || p->state == ZOMBIE)
+      continue;
+    p->wss = frame_wss(p->pgdir, WSWINDOW);
+    p->pff = p->majflt - p->lastmaj;
+    p->lastmaj = p->majflt;
+    if (p->pff >= PFFHIGH)
+      p->thrashing = 1;
+    else if (p->pff <= PFFLOW)
+      p->thrashing = 0;
+  }
+  release(&ptable.lock);
+}
+
+// Called from the scheduler loop, outside any process, so that
+// the timer interrupt only has to count ticks.  The first CPU
+// here in a new tick has frame_sample() look at the next batch of
+// reference bits, and has memsample() run once per WSINTERVAL.
+void memtick(void)
+{
+  static uint last;
+  uint t, old;
+
+  // The other CPUs get here before main() has built frames.
+  if (frames == 0)
+    return;
+  t = ticks;
+  old = last;
+  if (t == old || cmpxchg(&last, old, t) != old)
+    return;
+  frame_sample();
+  if (t / WSINTERVAL != old / WSINTERVAL)
+    memsample();
+}
+
+// Fill in up to n memstat records, one per live process.
+// Returns how many were filled in.
+int procmemstat(struct memstat *ms, int n)
+{
+  struct proc *p;
+  int i;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC] && i < n; p++)
+  {
+    if (p->state == UNUSED || p->state == EMBRYO)
+      continue;
+    ms[i].pid = p->pid;
+    ms[i].state = p->state;
+    safestrcpy(ms[i].name, p->name, sizeof(ms[i].name));
+    ms[i].minflt = p->minflt;
+    ms[i].majflt = p->majflt;
+    ms[i].rss = p->state == ZOMBIE ? 0 : frame_count(p->pgdir);
+    ms[i].swapped = p->state == ZOMBIE ? 0 : frame_nswapped(p->pgdir);
+    ms[i].wss = p->wss;
+    ms[i].pff = p->pff;
+    ms[i].thrashing = p->thrashing;
+    i++;
+  }
+  release(&ptable.lock);
+  return i;
+}
+
+// Called from the idle loop: let the same-page merger look at
+// its next batch of frames, with ptable.lock keeping their
+// owners from running meanwhile.  Returns 0 if it has already
+// had its turn this tick.
+int ksmscan(void)
+{
+  if (!ksm_due())
+    return 0;
+  acquire(&ptable.lock);
+  frame_ksmscan(evictable);
+  release(&ptable.lock);
+  return 1;
+}
+
+// Have uvmsplit() look at the superpages of processes whose
+// pages may be evicted, until it splits one.  Called by swapout()
+// with ptable.lock held.
+static void splitsuper(void)
+{
+  struct proc *p;
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    if (p->state != SLEEPING && p->state != RUNNABLE && p != myproc())
+      continue;
+    if (frame_nsuper(p->pgdir) > 0 && uvmsplit(p->pgdir))
+      return;
+  }
+}
+
+// Push one user page, chosen by the replacement policy, out to
+// swap to free its frame.  Superpages are split first once they
+// go cold, and then whenever nothing else can be evicted.
+// Returns 0 if no page could be evicted.
+int swapout(void)
+{
+  struct frame *f;
+  struct proc *p;
+  int slot, write;
+  char *mem;
+
+  acquire(&ptable.lock);
+  splitsuper();
+  if ((f = frame_victim(evictable)) == 0)
+  {
+    // The first call only cleared the accessed bits of the
+    // superpages left; now split one of them anyway.
+    splitsuper();
+    f = frame_victim(evictable);
+  }
+  if (f == 0)
+  {
+    release(&ptable.lock);
+    return 0;
+  }
+  p = pgdirproc(f->pgdir);
+  mem = P2V(FRAME2PA(f));
+  slot = swapmark(p, f, &write);
+  release(&ptable.lock);
+  if (slot < 0)
+    return 0;
+  if (!write || !swapwrite(slot, mem))
+    kfree(mem);
+  return 1;
+}
+
+// Look up pids from tick start until tick end, through the pid
+// hash under ptable.lock (mode 0) or under RCU (mode 1), to see
+// how lookups scale with CPUs.  Returns the number done.
+int rcubench(int mode, uint start, uint end)
+{
+  struct proc *p;
+  int n;
+
+  while (*(volatile uint *)&ticks < start)
+    ;
+  for (n = 0; *(volatile uint *)&ticks < end; n++)
+  {
+    if (mode == 0)
+    {
+      acquire(&ptable.lock);
+      p = findproc(n % NPROC + 1);
+      release(&ptable.lock);
+    }
+    else
+    {
+      rcu_read_lock();
+      p = findproc(n % NPROC + 1);
+      rcu_read_unlock();
+    }
+    if (p && p->pid != n % NPROC + 1)
+      panic("rcubench");
+  }
+  return n;
+}
@@ -1,5 +1,10 @@
-// Per-CPU state
+#include "rcu.h"
+
+// Per-CPU state.  Each CPU's %gs segment starts at its own
+// struct cpu, so mycpu() and myproc() are a single load.
 struct cpu {
+  struct cpu *self;            // %gs:0, for mycpu()
+  int id;                      // Index in cpus[], for cpuid()
   uchar apicid;                // Local APIC ID
   struct context *scheduler;   // swtch() here to enter scheduler
   struct taskstate ts;         // Used by x86 to find stack for interrupt
@@ -10,7 +15,8 @@ struct cpu {
   struct proc *proc;           // The process running on this cpu or null
   struct proc *runq;           
   int core_type;
-};
+  volatile int resched;        // A better process is queued: yield at the next tick
+} __attribute__((aligned(64)));  // no false sharing between CPUs
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
@@ -52,7 +58,12 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  int priority;
+  int priority;                // Scheduling priority, lower runs first
+  int effprio;                 // priority, or better if inherited (pi.c)
+  struct pi *blockedon;        // Sleeping lock being waited for
+  struct proc *piwnext;        // Next waiter for that lock
+  struct pi *boosts;           // Held locks that have waiters
+  struct plock *plocks;        // Priority locks held, through plock->nextheld
   int ticks_consumed;          // Ticks consumed in current quantum
   uint ctime;                  // Creation time
   struct proc *next;           // Next process in run queue
@@ -62,6 +73,27 @@ struct proc {
   int start_ticks;
   int finished_count;
   int cpu_id;
+
+  int npin;                    // Number of ranges in pin[]
+  struct {
+    uint lo, hi;
+  } pin[4];                    // Buffers of current syscall, kept out of swap
+
+  uint minflt;                 // Page faults served without the disk
+  uint majflt;                 // Page faults that read the disk
+  uint lastmaj;                // majflt when the interval began
+  uint pff;                    // Major faults in the last WSINTERVAL ticks
+  uint wss;                    // Working set estimate, in pages
+  int thrashing;               // Held back by the PFF controller
+
+  struct {
+    uint lo, hi;
+  } seq[NSEQ];                 // MADV_SEQUENTIAL ranges, hi == 0 if unused
+  int seqnext;                 // Entry of seq[] to reuse next
+  struct shm *shm;             // Shared memory at USHM, if any (shm.c)
+
+  struct proc *pidnext;        // Next in pid hash chain
+  struct rcu_head rcu;         // Frees the slot once readers are done
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -69,20 +101,3 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
-
-struct central_page_entry {
-  char *phys_addr;      
-  uint vpn;            
-  int pid;              
-  int valid;            
-  
-// از اینا برای الگوریتم های بخش ۲  
-  uint last_access;     // برای LRU
-  uint access_count;    // برای LFU
-  int clock_bit;        // برای Clock
-};
-
-struct {
-  struct spinlock lock;
-  struct central_page_entry entries[4];
-} central_ptable;
\ No newline at end of file
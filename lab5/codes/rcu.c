@@ -0,0 +1,191 @@
+// Read-copy update, quiescent-state based.
+//
+// Readers bracket lookups with rcu_read_lock()/rcu_read_unlock(),
+// which only turn interrupts off: a reader takes no lock and
+// writes nothing shared.  A reader must not sleep, so a CPU
+// that has gone through the scheduler, or taken a timer tick in
+// user space, holds no references from earlier read sections.
+// That is a quiescent state, reported by rcu_quiescent().
+//
+// A writer unlinks an object so new readers cannot find it and
+// hands it to call_rcu(); the callback runs once every CPU has
+// passed a quiescent state, when no reader can still hold it.
+// synchronize_rcu() sleeps until then instead, and objects that
+// are only reused, never freed, can note rcu_poll_start() and
+// wait for rcu_poll_done() before reuse.
+//
+// Grace periods are numbered.  One starts when a CPU has
+// callbacks waiting and none is in progress, and ends when each
+// CPU has reported a quiescent state since it started.
+// Callbacks queued while grace period n runs wait for n+1, since
+// a reader on a CPU that had already reported could have found
+// the object.  Each CPU keeps and runs its own callbacks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "percpu.h"
+
+struct rcucpu {
+  uint gp;                    // last grace period reported
+  struct rcu_head *next;      // queued, waiting for a grace period to start
+  struct rcu_head **nexttail;
+  struct rcu_head *wait;      // waiting for grace period waitgp to end
+  uint waitgp;
+};
+static DEFINE_PERCPU(struct rcucpu, rcucpus);
+
+struct {
+  struct spinlock lock;
+  volatile uint gpnum;        // last grace period started
+  volatile uint completed;    // last grace period ended
+  volatile uint need;         // last grace period anyone waits for
+  uint pending;               // CPUs yet to report in gpnum, a bit each
+} rcu;
+
+// a is b or later, allowing for wraparound.
+#define after_eq(a, b) ((int)((a) - (b)) >= 0)
+
+void rcuinit(void)
+{
+  int i;
+
+  initlock(&rcu.lock, "rcu");
+  for (i = 0; i < NCPU; i++)
+    per_cpu(rcucpus, i).nexttail = &per_cpu(rcucpus, i).next;
+}
+
+void rcu_read_lock(void)
+{
+  pushcli();
+}
+
+void rcu_read_unlock(void)
+{
+  popcli();
+}
+
+// Run func(h) after a grace period, on this CPU.  Callable with
+// interrupts off and locks held; func must not sleep.
+void call_rcu(struct rcu_head *h, void (*func)(struct rcu_head*))
+{
+  struct rcucpu *rc;
+
+  h->func = func;
+  h->next = 0;
+  pushcli();
+  rc = &this_cpu(rcucpus);
+  *rc->nexttail = h;
+  rc->nexttail = &h->next;
+  popcli();
+}
+
+// Start the next grace period if one is wanted.
+// Caller holds rcu.lock.
+static void startgp(void)
+{
+  if (rcu.completed != rcu.gpnum || after_eq(rcu.gpnum, rcu.need))
+    return;
+  rcu.gpnum++;
+  rcu.pending = (1 << ncpu) - 1;
+}
+
+// This CPU holds no references from read sections: report that
+// to the grace period in progress, move callbacks along and run
+// those whose grace period is over.  Called from the scheduler
+// loop with no locks held and from user-space timer ticks.
+void rcu_quiescent(void)
+{
+  struct rcucpu *rc;
+  struct rcu_head *done, *h, *next;
+
+  pushcli();
+  rc = &this_cpu(rcucpus);
+  // Nothing to do most of the time; leave rcu.lock alone.
+  if (rc->gp == rcu.gpnum && rcu.need == rcu.gpnum && rc->next == 0 &&
+     (rc->wait == 0 || !after_eq(rcu.completed, rc->waitgp))) {
+    popcli();
+    return;
+  }
+
+  done = 0;
+  acquire(&rcu.lock);
+  if (rc->gp != rcu.gpnum) {
+    rc->gp = rcu.gpnum;
+    rcu.pending &= ~(1 << cpuid());
+    if (rcu.pending == 0)
+      rcu.completed = rcu.gpnum;
+  }
+  if (rc->wait && after_eq(rcu.completed, rc->waitgp)) {
+    done = rc->wait;
+    rc->wait = 0;
+  }
+  if (rc->wait == 0 && rc->next) {
+    rc->wait = rc->next;
+    rc->next = 0;
+    rc->nexttail = &rc->next;
+    rc->waitgp = rcu.gpnum + 1;
+    if (!after_eq(rcu.need, rc->waitgp))
+      rcu.need = rc->waitgp;
+  }
+  startgp();
+  release(&rcu.lock);
+  popcli();
+
+  for (h = done; h; h = next) {
+    next = h->next;
+    h->func(h);
+  }
+}
+
+// A grace period to wait for before reusing something just
+// unlinked, to pass to rcu_poll_done().
+uint rcu_poll_start(void)
+{
+  uint gp;
+
+  acquire(&rcu.lock);
+  gp = rcu.gpnum + 1;
+  if (!after_eq(rcu.need, gp))
+    rcu.need = gp;
+  release(&rcu.lock);
+  return gp;
+}
+
+// Is grace period gp over?
+int rcu_poll_done(uint gp)
+{
+  return after_eq(rcu.completed, gp);
+}
+
+struct rcusync {
+  struct rcu_head h;
+  int done;
+};
+
+static void syncdone(struct rcu_head *h)
+{
+  struct rcusync *s = (struct rcusync*)h;
+
+  acquire(&rcu.lock);
+  s->done = 1;
+  wakeup(s);
+  release(&rcu.lock);
+}
+
+// Sleep until every read section that began before the call
+// has ended.  Process context only, outside read sections.
+void synchronize_rcu(void)
+{
+  struct rcusync s;
+
+  s.done = 0;
+  call_rcu(&s.h, syncdone);
+  acquire(&rcu.lock);
+  while (!s.done)
+    sleep(&s, &rcu.lock);
+  release(&rcu.lock);
+}
@@ -0,0 +1,11 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+// Callback deferred by call_rcu() until every CPU has passed a
+// quiescent state.  Embedded in the object it frees.
+struct rcu_head {
+  struct rcu_head *next;
+  void (*func)(struct rcu_head*);
+};
+
+#endif
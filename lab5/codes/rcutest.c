@@ -0,0 +1,86 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Pid lookup scaling: n workers look up pids in the kernel for
+// the same stretch of ticks, through the pid hash under
+// ptable.lock and then under RCU, for n = 1, 2, 4, ... up to
+// maxproc.  Locked lookups all pull the lock's cache line back
+// and forth, so their total stops growing after a CPU or two;
+// RCU readers write nothing shared and should scale with CPUs.
+//
+// rcutest [maxproc [ticks]]; run it with maxproc the number of
+// CPUs, e.g. after make qemu CPUS=4.
+
+#define MAXWORKER 16
+#define HZ 100 // timer ticks per second
+
+char *modes[] = {"locked", "rcu"};
+
+// Lookups per second by nproc workers.
+uint run(int mode, int nproc, int nticks)
+{
+  int fd[2], i, n;
+  uint start, total;
+
+  if (pipe(fd) < 0)
+  {
+    printf(1, "rcutest: pipe failed\n");
+    exit();
+  }
+  // Give every worker time to get going before the start.
+  start = uptime() + 10;
+  for (i = 0; i < nproc; i++)
+  {
+    if (fork() == 0)
+    {
+      close(fd[0]);
+      n = rcubench(mode, start, start + nticks);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+  total = 0;
+  for (i = 0; i < nproc; i++)
+    if (read(fd[0], &n, sizeof(n)) == sizeof(n))
+      total += n;
+  close(fd[0]);
+  for (i = 0; i < nproc; i++)
+    wait();
+  return total / nticks * HZ;
+}
+
+int main(int argc, char *argv[])
+{
+  int maxproc, nticks, nproc, mode;
+  uint rate[2];
+
+  maxproc = 4;
+  nticks = 100;
+  if (argc > 1)
+    maxproc = atoi(argv[1]);
+  if (argc > 2)
+    nticks = atoi(argv[2]);
+  if (maxproc < 1 || maxproc > MAXWORKER || nticks < 1)
+  {
+    printf(1, "usage: rcutest [maxproc [ticks]]\n");
+    exit();
+  }
+
+  printf(1, "%d ticks per run, lookups per second\n", nticks);
+  printf(1, "workers\t%s\t\t%s\t\tspeedup\n", modes[0], modes[1]);
+  for (nproc = 1;; nproc *= 2)
+  {
+    if (nproc > maxproc)
+      nproc = maxproc;
+    for (mode = 0; mode < 2; mode++)
+      rate[mode] = run(mode, nproc, nticks);
+    printf(1, "%d\t%d\t\t%d\t\t%d.%dx\n", nproc, rate[0], rate[1],
+           rate[0] ? rate[1] / rate[0] : 0,
+           rate[0] ? rate[1] * 10 / rate[0] % 10 : 0);
+    if (nproc == maxproc)
+      break;
+  }
+  exit();
+}
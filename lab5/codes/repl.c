@@ -0,0 +1,470 @@
+// Page replacement policies.
+//
+// The frame table (frame.c) tells the active policy as user
+// pages are mapped, referenced and unmapped; the policy keeps
+// their frames on its own lists and, when swapout() needs room,
+// chooses the one to evict.  Everything here runs with the
+// frame table locked.
+//
+// LRU, LFU, Clock, 2Q and ARC are built in; repl_setpolicy()
+// switches between them at run time by re-inserting every
+// frame into the new policy.  Counters are kept per policy so
+// runs of the same workload under each can be compared.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "frame.h"
+#include "repl.h"
+
+#define NGHOST  1024  // remembered evictions per ghost list
+
+// A list of frames, most recently used at the head.
+struct flist {
+  struct frame *head;
+  struct frame *tail;
+  uint n;
+};
+
+// Evicted pages, remembered by 2Q and ARC so a quick return
+// tells them the page should have stayed.
+struct ghostq {
+  struct {
+    pde_t *pgdir;
+    uint vpn;
+  } g[NGHOST];
+  uint next;
+  uint n;
+};
+
+struct {
+  struct policy *cur;
+  int curid;
+  struct replstat stat[NPOLICY];
+  struct flist l[2];      // the policy's lists, q == 1 or 2
+  struct ghostq gh[2];
+  struct frame *clock;    // Clock's hand
+  uint target;            // ARC's target size for l[0]
+} repl;
+
+static void
+lpush(int q, struct frame *f)
+{
+  struct flist *l = &repl.l[q-1];
+
+  f->q = q;
+  f->prev = 0;
+  f->next = l->head;
+  if(l->head)
+    l->head->prev = f;
+  else
+    l->tail = f;
+  l->head = f;
+  l->n++;
+}
+
+static void
+lpushtail(int q, struct frame *f)
+{
+  struct flist *l = &repl.l[q-1];
+
+  f->q = q;
+  f->next = 0;
+  f->prev = l->tail;
+  if(l->tail)
+    l->tail->next = f;
+  else
+    l->head = f;
+  l->tail = f;
+  l->n++;
+}
+
+static void
+lunlink(struct frame *f)
+{
+  struct flist *l;
+
+  if(f->q == 0)
+    return;
+  l = &repl.l[f->q-1];
+  if(f->prev)
+    f->prev->next = f->next;
+  else
+    l->head = f->next;
+  if(f->next)
+    f->next->prev = f->prev;
+  else
+    l->tail = f->prev;
+  l->n--;
+  f->q = 0;
+  f->prev = f->next = 0;
+}
+
+// Least recently used frame on list q that ok() accepts.
+static struct frame*
+lscan(int q, int (*ok)(struct frame*))
+{
+  struct frame *f;
+
+  for(f = repl.l[q-1].tail; f; f = f->prev)
+    if(ok(f))
+      return f;
+  return 0;
+}
+
+static void
+ghostadd(int q, struct frame *f)
+{
+  struct ghostq *gq = &repl.gh[q-1];
+  uint i = gq->next++ % NGHOST;
+
+  if(gq->g[i].pgdir)
+    gq->n--;
+  gq->g[i].pgdir = f->pgdir;
+  gq->g[i].vpn = f->vpn;
+  gq->n++;
+}
+
+// Forget f's page if ghost list q remembers it; return 1 if it did.
+static int
+ghosttake(int q, struct frame *f)
+{
+  struct ghostq *gq = &repl.gh[q-1];
+  int i;
+
+  if(gq->n == 0)
+    return 0;
+  for(i = 0; i < NGHOST; i++){
+    if(gq->g[i].pgdir == f->pgdir && gq->g[i].vpn == f->vpn){
+      gq->g[i].pgdir = 0;
+      gq->n--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+listinit(void)
+{
+  memset(repl.l, 0, sizeof(repl.l));
+  memset(repl.gh, 0, sizeof(repl.gh));
+  repl.clock = 0;
+  repl.target = 0;
+}
+
+static void
+remove1(struct frame *f, int evicted)
+{
+  lunlink(f);
+}
+
+// LRU: one list in order of last sampled reference.
+
+static void
+lru_insert(struct frame *f, int refault)
+{
+  lpush(1, f);
+}
+
+static void
+lru_access(struct frame *f)
+{
+  lunlink(f);
+  lpush(1, f);
+}
+
+static struct frame*
+lru_victim(int (*ok)(struct frame*))
+{
+  return lscan(1, ok);
+}
+
+static struct policy lru = {
+  "lru", listinit, lru_insert, lru_access, remove1, lru_victim,
+};
+
+// LFU: fewest sampled references; the older page on ties.
+
+static void
+lfu_access(struct frame *f)
+{
+  f->count++;
+}
+
+static struct frame*
+lfu_victim(int (*ok)(struct frame*))
+{
+  struct frame *f, *best;
+
+  best = 0;
+  for(f = repl.l[0].tail; f; f = f->prev)
+    if((best == 0 || f->count < best->count) && ok(f))
+      best = f;
+  return best;
+}
+
+static struct policy lfu = {
+  "lfu", listinit, lru_insert, lfu_access, remove1, lfu_victim,
+};
+
+// Clock: the hand sweeps from tail to head and round again,
+// clearing reference bits, and stops at the first clear one.
+
+static void
+clock_insert(struct frame *f, int refault)
+{
+  f->ref = 1;
+  lpush(1, f);
+}
+
+static void
+clock_access(struct frame *f)
+{
+  f->ref = 1;
+}
+
+static void
+clock_remove(struct frame *f, int evicted)
+{
+  if(repl.clock == f)
+    repl.clock = f->prev;
+  lunlink(f);
+}
+
+static struct frame*
+clock_victim(int (*ok)(struct frame*))
+{
+  struct frame *f;
+  uint i;
+
+  for(i = 0; i < 2*repl.l[0].n + 1; i++){
+    if(repl.clock == 0)
+      repl.clock = repl.l[0].tail;
+    if((f = repl.clock) == 0)
+      return 0;
+    repl.clock = f->prev;
+    if(f->ref)
+      f->ref = 0;
+    else if(ok(f))
+      return f;
+  }
+  return 0;
+}
+
+static struct policy clock = {
+  "clock", listinit, clock_insert, clock_access, clock_remove, clock_victim,
+};
+
+// 2Q: new pages wait in a FIFO (l[0], "A1in"); only a page that
+// comes back soon after leaving it (found in gh[0], "A1out")
+// earns a place on the LRU list of hot pages (l[1], "Am").
+// A1in is kept to about a quarter of resident pages.
+
+static void
+twoq_insert(struct frame *f, int refault)
+{
+  if(refault && ghosttake(1, f))
+    lpush(2, f);
+  else
+    lpush(1, f);
+}
+
+static void
+twoq_access(struct frame *f)
+{
+  if(f->q == 2){
+    lunlink(f);
+    lpush(2, f);
+  }
+}
+
+static void
+twoq_remove(struct frame *f, int evicted)
+{
+  if(evicted && f->q == 1)
+    ghostadd(1, f);
+  lunlink(f);
+}
+
+static struct frame*
+twoq_victim(int (*ok)(struct frame*))
+{
+  struct frame *f;
+  uint nres = repl.l[0].n + repl.l[1].n;
+
+  if(repl.l[0].n > nres/4 && (f = lscan(1, ok)) != 0)
+    return f;
+  if((f = lscan(2, ok)) != 0)
+    return f;
+  return lscan(1, ok);
+}
+
+static struct policy twoq = {
+  "2q", listinit, twoq_insert, twoq_access, twoq_remove, twoq_victim,
+};
+
+// ARC: l[0] ("T1") holds pages seen once, l[1] ("T2") pages seen
+// again, and gh[0]/gh[1] ("B1"/"B2") remember what was evicted
+// from each.  A refault found in B1 grows the target size of T1,
+// one found in B2 shrinks it.
+
+static void
+arc_insert(struct frame *f, int refault)
+{
+  uint c = repl.l[0].n + repl.l[1].n + 1;
+  uint b1 = repl.gh[0].n, b2 = repl.gh[1].n, d;
+
+  if(refault && ghosttake(1, f)){
+    d = b2 > b1 ? b2/(b1+1) : 1;
+    repl.target = repl.target + d > c ? c : repl.target + d;
+    lpush(2, f);
+  } else if(refault && ghosttake(2, f)){
+    d = b1 > b2 ? b1/(b2+1) : 1;
+    repl.target = repl.target > d ? repl.target - d : 0;
+    lpush(2, f);
+  } else
+    lpush(1, f);
+}
+
+static void
+arc_access(struct frame *f)
+{
+  lunlink(f);
+  lpush(2, f);
+}
+
+static void
+arc_remove(struct frame *f, int evicted)
+{
+  if(evicted && f->q)
+    ghostadd(f->q, f);
+  lunlink(f);
+}
+
+static struct frame*
+arc_victim(int (*ok)(struct frame*))
+{
+  struct frame *f;
+
+  if(repl.l[0].n > 0 && (repl.l[0].n > repl.target || repl.l[1].n == 0))
+    if((f = lscan(1, ok)) != 0)
+      return f;
+  if((f = lscan(2, ok)) != 0)
+    return f;
+  return lscan(1, ok);
+}
+
+static struct policy arc = {
+  "arc", listinit, arc_insert, arc_access, arc_remove, arc_victim,
+};
+
+static struct policy *policies[NPOLICY] = {
+  [POLICY_LRU]   &lru,
+  [POLICY_LFU]   &lfu,
+  [POLICY_CLOCK] &clock,
+  [POLICY_2Q]    &twoq,
+  [POLICY_ARC]   &arc,
+};
+
+void
+replinit(void)
+{
+  repl.curid = POLICY_CLOCK;
+  repl.cur = policies[repl.curid];
+  repl.cur->init();
+}
+
+// Make every user page start over under policy n.
+// Returns the previous policy, or -1 if n is not one.
+int
+repl_setpolicy(int n)
+{
+  struct frame *f;
+  int old;
+
+  if(n < 0 || n >= NPOLICY)
+    return -1;
+  old = repl.curid;
+  repl.curid = n;
+  repl.cur = policies[n];
+  repl.cur->init();
+  for(f = frames; f < &frames[NFRAME]; f++){
+    if(f->pgdir == 0)
+      continue;
+    f->q = 0;
+    f->prev = f->next = 0;
+    f->ref = 0;
+    f->count = 0;
+    repl.cur->on_insert(f, 0);
+  }
+  return old;
+}
+
+void
+repl_insert(struct frame *f, int refault)
+{
+  f->ref = 0;
+  f->count = 0;
+  f->last = ticks;
+  repl.cur->on_insert(f, refault);
+  if(refault)
+    repl.stat[repl.curid].faults++;
+}
+
+void
+repl_access(struct frame *f)
+{
+  f->last = ticks;
+  repl.stat[repl.curid].hits++;
+  repl.cur->on_access(f);
+}
+
+// f is being unmapped.  If it is being evicted, write says
+// whether its contents had to go to disk.
+void
+repl_remove(struct frame *f, int evicted, int write)
+{
+  repl.cur->on_remove(f, evicted);
+  if(evicted)
+    repl.stat[repl.curid].evictions++;
+  if(write)
+    repl.stat[repl.curid].writebacks++;
+}
+
+// f will not be wanted again soon: move it to the tail of the
+// first list with no references counted, where every policy
+// looks first for its next victim.
+void
+repl_cold(struct frame *f)
+{
+  repl.cur->on_remove(f, 0);
+  f->ref = 0;
+  f->count = 0;
+  lpushtail(1, f);
+}
+
+// Ask the policy for a page to evict, among those ok() accepts.
+struct frame*
+repl_victim(int (*ok)(struct frame*))
+{
+  return repl.cur->choose_victim(ok);
+}
+
+void
+repldump(void)
+{
+  struct replstat *s;
+  int i;
+
+  cprintf("policy\tfaults\thits\tevicts\twrites\n");
+  for(i = 0; i < NPOLICY; i++){
+    s = &repl.stat[i];
+    cprintf("%s%s\t%d\t%d\t%d\t%d\n", policies[i]->name,
+            i == repl.curid ? "*" : "",
+            s->faults, s->hits, s->evictions, s->writebacks);
+  }
+}
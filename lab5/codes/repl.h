@@ -0,0 +1,29 @@
+// Page replacement policies, which pick the user page that
+// swapout() evicts next.
+
+struct frame;
+
+// A replacement policy.  All hooks are called with the frame
+// table locked.
+struct policy {
+  char *name;
+  void (*init)(void);                       // empty all lists
+  void (*on_insert)(struct frame*, int);    // page mapped; 1 if back from swap
+  void (*on_access)(struct frame*);         // page seen referenced
+  void (*on_remove)(struct frame*, int);    // page unmapped; 1 if evicted
+  struct frame *(*choose_victim)(int (*ok)(struct frame*));
+};
+
+struct replstat {
+  uint faults;         // pages read back from swap
+  uint hits;           // sampled references to resident pages
+  uint evictions;      // pages pushed out to swap
+  uint writebacks;     // evictions that had to write the page
+};
+
+#define POLICY_LRU    0
+#define POLICY_LFU    1
+#define POLICY_CLOCK  2
+#define POLICY_2Q     3
+#define POLICY_ARC    4
+#define NPOLICY       5
@@ -0,0 +1,65 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "repl.h"
+
+#define PGSIZE 4096
+#define MB (1024 * 1024)
+#define ROUNDS 8
+
+char *names[NPOLICY] = {"lru", "lfu", "clock", "2q", "arc"};
+
+// Touch one word in each of npages pages starting at page first.
+void touch(char *mem, int first, int npages)
+{
+  int i;
+
+  for (i = 0; i < npages; i++)
+    mem[(first + i) * PGSIZE]++;
+}
+
+// Run the same paging workload under every replacement policy
+// and print how long each took; print_stats() then shows the
+// faults, hits, evictions and write-backs of each.  The region
+// is bigger than physical memory (PHYSTOP is 224MB): a hot
+// eighth of it is used over and over while the rest is
+// scanned through once per round, which is what separates
+// the scan-resistant policies (2Q, ARC) from plain LRU.
+int main(int argc, char *argv[])
+{
+  int mb, npages, nhot, ncold, chunk, pol, r, t0;
+  char *mem;
+
+  mb = 256;
+  if (argc > 1)
+    mb = atoi(argv[1]);
+  npages = mb * (MB / PGSIZE);
+  nhot = npages / 8;
+  ncold = npages - nhot;
+  chunk = ncold / ROUNDS;
+
+  mem = sbrk(npages * PGSIZE);
+  if (mem == (char *)-1)
+  {
+    printf(1, "repltest: sbrk failed\n");
+    exit();
+  }
+  touch(mem, 0, npages);
+
+  for (pol = 0; pol < NPOLICY; pol++)
+  {
+    setpolicy(pol);
+    t0 = uptime();
+    for (r = 0; r < ROUNDS; r++)
+    {
+      touch(mem, 0, nhot);
+      touch(mem, nhot + r * chunk, chunk);
+      touch(mem, 0, nhot);
+    }
+    printf(1, "%s: %d ticks\n", names[pol], uptime() - t0);
+  }
+  setpolicy(POLICY_CLOCK);
+
+  print_stats();
+  exit();
+}
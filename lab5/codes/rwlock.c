@@ -1,70 +1,278 @@
+// Reader-writer locks for processes.
+//
+// A reader increments its CPU's counter and, unless a writer is
+// pending, is done: the fast path touches no shared cache line
+// that a writer is not already dirtying.  A reader may sleep and
+// release on another CPU, so only the sum of the counters means
+// anything.
+//
+// A writer sets wpending, which turns new readers away to the
+// slow path, and then sleeps until the counters add up to zero.
+// Writers queue FIFO and the lock is handed to one at a time.
+// When a writer releases, readers that queued up behind it are
+// let in as one batch before the next writer, so neither side
+// can starve the other.
+
 #include "types.h"
 #include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
 #include "rwlock.h"
 
+// A waiting writer, on its own kernel stack.
+struct rwwait {
+  int granted;
+  struct rwwait *next;
+};
 
 struct rwlock global_rwlock;
 
 void rwlock_init(struct rwlock *rw, char *name)
 {
+  int i;
+
   initlock(&rw->lk, "rwlock");
-  rw->read_count = 0;
+  rw->wpending = 0;
   rw->writer = 0;
+  rw->whead = rw->wtail = 0;
+  rw->nrwait = 0;
+  rw->rgen = 0;
   rw->name = name;
+  for (i = 0; i < NCPU; i++)
+    rw->readers[i].n = 0;
 }
 
+// Readers inside, or about to find wpending set and back out.
+// Caller holds rw->lk.
+static int readers(struct rwlock *rw)
+{
+  int i, n;
 
+  n = 0;
+  for (i = 0; i < NCPU; i++)
+    n += rw->readers[i].n;
+  return n;
+}
 
-void rwlock_acquire_read(struct rwlock *rw)
+// Count this CPU's reader in or out.  The locked add is also
+// the barrier that orders it before the read of wpending.
+static int readadd(struct rwlock *rw, int n)
 {
-  acquire(&rw->lk);
-
-  while (rw->writer) {
-    sleep(rw, &rw->lk);
-  }
+  int pending;
 
-  rw->read_count++;
+  pushcli();
+  __sync_fetch_and_add(&rw->readers[cpuid()].n, n);
+  pending = rw->wpending;
+  popcli();
+  return pending;
+}
 
+// A reader went away while a writer may be waiting for it.
+static void readgone(struct rwlock *rw)
+{
+  acquire(&rw->lk);
+  if (rw->writer)
+    wakeup(&rw->writer);
   release(&rw->lk);
 }
 
+// Take rw for reading without sleeping.  Returns 1 on success.
+int rwlock_tryread(struct rwlock *rw)
+{
+  if (!readadd(rw, 1))
+    return 1;
+  if (readadd(rw, -1))
+    readgone(rw);
+  return 0;
+}
 
-void rwlock_release_read(struct rwlock *rw)
+void rwlock_acquire_read(struct rwlock *rw)
 {
-  acquire(&rw->lk);
+  uint gen;
 
-  rw->read_count--;
+  if (rwlock_tryread(rw))
+    return;
 
-  if (rw->read_count == 0) {
-    wakeup(rw);
+  acquire(&rw->lk);
+  if (!rw->wpending) {
+    // The writers went away meanwhile.
+    readadd(rw, 1);
+    release(&rw->lk);
+    return;
+  }
+  // Wait to be let in with the next batch; the writer that
+  // lets us in has already counted us.
+  gen = rw->rgen;
+  rw->nrwait++;
+  while (rw->rgen == gen) {
+    sleep(&rw->rgen, &rw->lk);
   }
-
   release(&rw->lk);
 }
 
-
-void rwlock_acquire_write(struct rwlock *rw)
+void rwlock_release_read(struct rwlock *rw)
 {
-  acquire(&rw->lk);
+  if (readadd(rw, -1))
+    readgone(rw);
+}
 
-  while (rw->writer || rw->read_count > 0) {
-    sleep(rw, &rw->lk);
+// Caller holds rw->lk and has made itself the writer.
+static void waitreaders(struct rwlock *rw)
+{
+  rw->wpending = 1;
+  __sync_synchronize();
+  while (readers(rw) > 0) {
+    sleep(&rw->writer, &rw->lk);
   }
+}
 
-  rw->writer = 1;
+// Take rw for writing without sleeping.  Returns 1 on success.
+int rwlock_trywrite(struct rwlock *rw)
+{
+  int ok;
 
+  acquire(&rw->lk);
+  ok = 0;
+  if (!rw->writer && rw->whead == 0) {
+    rw->wpending = 1;
+    __sync_synchronize();
+    if (readers(rw) == 0) {
+      rw->writer = 1;
+      ok = 1;
+    } else {
+      rw->wpending = 0;
+    }
+  }
   release(&rw->lk);
+  return ok;
 }
 
+void rwlock_acquire_write(struct rwlock *rw)
+{
+  struct rwwait w;
+
+  acquire(&rw->lk);
+  if (rw->writer || rw->whead) {
+    w.granted = 0;
+    w.next = 0;
+    if (rw->wtail)
+      rw->wtail->next = &w;
+    else
+      rw->whead = &w;
+    rw->wtail = &w;
+    rw->wpending = 1;
+    while (!w.granted) {
+      sleep(&w, &rw->lk);
+    }
+  } else {
+    rw->writer = 1;
+  }
+  waitreaders(rw);
+  release(&rw->lk);
+}
 
 void rwlock_release_write(struct rwlock *rw)
 {
-  acquire(&rw->lk);
+  struct rwwait *w;
 
+  acquire(&rw->lk);
   rw->writer = 0;
 
-  wakeup(rw);
+  // Wake-all-readers: everyone who queued behind us gets in,
+  // counted here on their behalf so that a writer handed the
+  // lock below waits for them.
+  if (rw->nrwait > 0) {
+    rw->readers[cpuid()].n += rw->nrwait;
+    rw->nrwait = 0;
+    rw->rgen++;
+    wakeup(&rw->rgen);
+  }
 
+  // Wake-one-writer: hand the lock to the oldest waiting
+  // writer, which keeps wpending up for it.
+  if ((w = rw->whead) != 0) {
+    rw->whead = w->next;
+    if (rw->whead == 0)
+      rw->wtail = 0;
+    rw->writer = 1;
+    w->granted = 1;
+    wakeup(w);
+  } else {
+    rw->wpending = 0;
+  }
   release(&rw->lk);
 }
+
+// Poll try() once a tick for at most timeout ticks.  Returns 0
+// once it succeeds, -1 on timeout or if the process is killed.
+// A timed writer does not hold readers back while it waits.
+static int trytimed(struct rwlock *rw, int (*try)(struct rwlock*), int timeout)
+{
+  uint start;
+
+  start = ticks;
+  for (;;) {
+    if (try(rw))
+      return 0;
+    acquire(&tickslock);
+    if (ticks - start >= timeout || myproc()->killed) {
+      release(&tickslock);
+      return -1;
+    }
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+  }
+}
+
+int rwlock_acquire_read_timeout(struct rwlock *rw, int timeout)
+{
+  return trytimed(rw, rwlock_tryread, timeout);
+}
+
+int rwlock_acquire_write_timeout(struct rwlock *rw, int timeout)
+{
+  return trytimed(rw, rwlock_trywrite, timeout);
+}
+
+// Benchmark, see rwlocktest.c: from tick start to tick end, take
+// one lock shared by all callers, for writing writepct percent of
+// the time and for reading otherwise.  Returns how many times
+// this caller got it, or -1.
+#define NRWBENCH 4
+
+static struct rwlock benchrw = {
+  .lk = { .name = "rwbench", .type = LOCK_TICKET },
+  .name = "rwbench",
+};
+static uint benchdata[NRWBENCH * 16];
+
+int rwbench(int writepct, uint start, uint end)
+{
+  uint seed, sum;
+  int i, n;
+
+  if (writepct < 0 || writepct > 100 || end < start)
+    return -1;
+  seed = myproc()->pid;
+  sum = 0;
+  while (*(volatile uint*)&ticks < start)
+    pause();
+  for (n = 0; *(volatile uint*)&ticks < end; n++) {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 100 < writepct) {
+      rwlock_acquire_write(&benchrw);
+      for (i = 0; i < NRWBENCH; i++)
+        benchdata[i * 16]++;
+      rwlock_release_write(&benchrw);
+    } else {
+      rwlock_acquire_read(&benchrw);
+      for (i = 0; i < NRWBENCH; i++)
+        sum += *(volatile uint*)&benchdata[i * 16];
+      rwlock_release_read(&benchrw);
+    }
+  }
+  return n;
+}
@@ -2,11 +2,26 @@
 #define _RWLOCK_H_
 
 #include "spinlock.h"
+#include "percpu.h"
 
+struct rwwait;
+
+// Read-mostly reader-writer lock.  Readers only count themselves
+// in their CPU's counter; a writer raises wpending, which sends
+// new readers to the slow path under lk, and waits for the
+// counters to add up to zero.
 struct rwlock {
-  struct spinlock lk;   
-  int read_count;      
-  int writer;           
-  char *name;  } ;       
+  struct spinlock lk;
+  volatile int wpending;  // a writer holds the lock or waits for it
+  int writer;             // held (or handed) for writing
+  struct rwwait *whead;   // waiting writers, oldest first
+  struct rwwait *wtail;
+  int nrwait;             // readers waiting for the writers to go
+  uint rgen;              // bumped when waiting readers are let in
+  char *name;
+  struct {
+    volatile int n;       // read acquires minus releases on this CPU
+  } CACHE_ALIGNED readers[NCPU];
+};
 
 #endif
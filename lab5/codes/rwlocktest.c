@@ -32,7 +32,9 @@ void writer(int id)
     exit();
 }
 
-int main(void)
+// Readers and a writer taking the lock in turn, as before the
+// benchmark.
+void demo(void)
 {
     printf(1, "Starting RWLock Test\n");
 
@@ -59,5 +61,64 @@ int main(void)
     }
 
     printf(1, "RWLock Test Finished.\n");
+}
+
+// nproc workers take one kernel rwlock for nticks ticks, writing
+// writepct percent of the time; prints acquisitions per tick.
+void bench(int writepct, int nproc, int nticks)
+{
+    int fd[2], i, n, total;
+    uint start;
+
+    if (pipe(fd) < 0)
+    {
+        printf(1, "rwlocktest: pipe failed\n");
+        exit();
+    }
+    start = uptime() + 10;
+    for (i = 0; i < nproc; i++)
+    {
+        if (fork() == 0)
+        {
+            close(fd[0]);
+            n = rwbench(writepct, start, start + nticks);
+            write(fd[1], &n, sizeof(n));
+            exit();
+        }
+    }
+    close(fd[1]);
+    total = 0;
+    for (i = 0; i < nproc; i++)
+    {
+        if (read(fd[0], &n, sizeof(n)) == sizeof(n))
+            total += n;
+    }
+    close(fd[0]);
+    for (i = 0; i < nproc; i++)
+        wait();
+    printf(1, "%d%%\t%d\n", writepct, total / nticks);
+}
+
+int ratios[] = {0, 1, 10, 25, 50, 100};
+
+// rwlocktest [nproc [ticks]]: the demo, then the benchmark across
+// read/write ratios with nproc workers (the number of CPUs).
+int main(int argc, char *argv[])
+{
+    int nproc, nticks, i;
+
+    nproc = 4;
+    nticks = 100;
+    if (argc > 1)
+        nproc = atoi(argv[1]);
+    if (argc > 2)
+        nticks = atoi(argv[2]);
+
+    demo();
+
+    printf(1, "\n%d workers, %d ticks per ratio\n", nproc, nticks);
+    printf(1, "writes\tacq/tick\n");
+    for (i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++)
+        bench(ratios[i], nproc, nticks);
     exit();
-}
\ No newline at end of file
+}
@@ -0,0 +1,73 @@
+// Sequence locks.
+//
+//   do {
+//     s = read_seqbegin(&sl);
+//     copy the data out;
+//   } while (read_seqretry(&sl, s));
+//
+// Data that has a single writer, or whose writers already hold
+// another lock, can use write_seqbegin()/write_seqend() and skip
+// the spinlock; write_seqlock()/write_sequnlock() take it.
+//
+// x86 keeps stores in order and loads in order, so the only
+// barriers needed are for the compiler.  A reader may see a
+// half-written copy, but then sees seq change and retries, so
+// the data must be copied out before it is used, and must not
+// contain pointers the reader follows inside the loop.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "seqlock.h"
+
+#define barrier() __asm__ volatile("" ::: "memory")
+
+void initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lk, name);
+  sl->seq = 0;
+}
+
+uint read_seqbegin(struct seqlock *sl)
+{
+  uint s;
+
+  while ((s = sl->seq) & 1)
+    pause();
+  barrier();
+  return s;
+}
+
+// Did a writer get in since read_seqbegin() returned s?
+int read_seqretry(struct seqlock *sl, uint s)
+{
+  barrier();
+  return sl->seq != s;
+}
+
+// Caller keeps other writers out.
+void write_seqbegin(struct seqlock *sl)
+{
+  sl->seq++;
+  barrier();
+}
+
+void write_seqend(struct seqlock *sl)
+{
+  barrier();
+  sl->seq++;
+}
+
+void write_seqlock(struct seqlock *sl)
+{
+  acquire(&sl->lk);
+  write_seqbegin(sl);
+}
+
+void write_sequnlock(struct seqlock *sl)
+{
+  write_seqend(sl);
+  release(&sl->lk);
+}
@@ -0,0 +1,16 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include "spinlock.h"
+
+// Sequence lock for small read-mostly data.  A writer makes seq
+// odd, updates the data and makes seq even again; a reader
+// copies the data and retries if seq was odd or has moved.
+// Readers never write to the lock, so they do not take its cache
+// line away from each other or from the writer.
+struct seqlock {
+  volatile uint seq;    // odd while a write is in progress
+  struct spinlock lk;   // serializes write_seqlock() writers
+};
+
+#endif
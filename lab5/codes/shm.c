@@ -0,0 +1,117 @@
+// Shared memory segments.
+//
+// mapshared() gives a process up to NSHMPG zeroed pages at USHM,
+// above anything its heap can grow into.  fork() maps the same
+// frames into the child instead of copying them, so a parent and
+// its children can share data, and the futex words in it (see
+// futex.c).  The pages stay out of the frame table, so swap and
+// same-page merging never see them.  They are freed when the
+// last process that maps them exits or execs.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct shm {
+  int ref;                // processes mapping it, 0 if free
+  int npages;
+  uint pa[NSHMPG];
+};
+
+static struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtable;
+
+void shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Map s at USHM in pgdir.  The segment fits in one page table,
+// so only the first page can fail, and then nothing is mapped.
+static int shmmap(pde_t *pgdir, struct shm *s)
+{
+  int i;
+
+  for (i = 0; i < s->npages; i++)
+    if (mappages(pgdir, (char *)USHM + i * PGSIZE, PGSIZE, s->pa[i], PTE_W | PTE_U) < 0)
+      return -1;
+  return 0;
+}
+
+// Give p, the current process, a new segment of npages pages.
+// Returns its address, or -1.
+int shm_alloc(struct proc *p, int npages)
+{
+  struct shm *s;
+  char *mem;
+
+  if (p->shm || npages < 1 || npages > NSHMPG)
+    return -1;
+
+  acquire(&shmtable.lock);
+  for (s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if (s->ref == 0)
+      break;
+  if (s == &shmtable.shm[NSHM]) {
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->ref = 1;
+  s->npages = 0;
+  release(&shmtable.lock);
+
+  while (s->npages < npages) {
+    if ((mem = kalloc_zeroed()) == 0)
+      goto bad;
+    s->pa[s->npages++] = V2P(mem);
+  }
+  if (shmmap(p->pgdir, s) < 0)
+    goto bad;
+  p->shm = s;
+  return USHM;
+
+bad:
+  shm_put(s);
+  return -1;
+}
+
+// fork() is giving np, the child, the parent's segment s.
+int shm_dup(struct proc *np, struct shm *s)
+{
+  if (s == 0)
+    return 0;
+  if (shmmap(np->pgdir, s) < 0)
+    return -1;
+  acquire(&shmtable.lock);
+  s->ref++;
+  release(&shmtable.lock);
+  np->shm = s;
+  return 0;
+}
+
+// A process has stopped mapping s: it has exited, or exec()
+// has replaced its page table.
+void shm_put(struct shm *s)
+{
+  int i;
+
+  if (s == 0)
+    return;
+  acquire(&shmtable.lock);
+  if (--s->ref == 0)
+    for (i = 0; i < s->npages; i++)
+      kfree(P2V(s->pa[i]));
+  release(&shmtable.lock);
+}
+
+// Is user address va in p's segment?
+int shm_has(struct proc *p, uint va)
+{
+  return p->shm && va >= USHM && va < USHM + p->shm->npages * PGSIZE;
+}
@@ -0,0 +1,251 @@
+// Slab allocator for small kernel objects.
+//
+// kmem_cache_alloc()/kmem_cache_free() serve objects of one
+// size from a struct kmem_cache; kmalloc()/kmfree() pick one
+// of the power-of-two size class caches below.  A slab is a
+// single page from kalloc() with a struct slab header at its
+// start, so any object's slab (and hence cache) is found by
+// rounding its address down to a page boundary.
+//
+// A free object's link to the next one lives in the word just
+// past the object, so whatever state a constructor sets up
+// survives until the object is allocated again.  Callers
+// must free objects in that constructed state.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;        // on cache->partial
+  struct slab *prev;
+  void *freelist;           // free objects in this slab
+  int inuse;                // objects handed out (or in magazines)
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+#define STRIDE(c) (((c)->size + sizeof(void*) + 7) & ~7)
+#define LINK(c, obj) (*(void**)((char*)(obj) + (c)->size))
+#define KMALLOC_MIN 16
+#define KMALLOC_MAX 1024
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache *head;
+} cachelist;
+
+// kmalloc() size classes: 16, 32, ..., KMALLOC_MAX bytes.
+static struct kmem_cache kmalloc_caches[7];
+static char *kmalloc_names[] = {
+  "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+void
+slabinit(void)
+{
+  int i;
+
+  initlock(&cachelist.lock, "cachelist");
+  for(i = 0; i < NELEM(kmalloc_caches); i++)
+    kmem_cache_init(&kmalloc_caches[i], kmalloc_names[i],
+                    KMALLOC_MIN << i, 0);
+}
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size,
+                void (*ctor)(void*))
+{
+  size = (size + 7) & ~7;
+  if(size == 0 || SLABHDR + size + sizeof(void*) > PGSIZE)
+    panic("kmem_cache_init");
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, "kmem_cache");
+  c->name = name;
+  c->size = size;
+  c->ctor = ctor;
+
+  acquire(&cachelist.lock);
+  c->next = cachelist.head;
+  cachelist.head = c;
+  release(&cachelist.lock);
+}
+
+// Get a fresh page for c, construct its objects and
+// put it on c->partial.  Caller holds c->lock.
+static struct slab*
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  for(obj = (char*)s + PGSIZE - STRIDE(c); obj >= (char*)s + SLABHDR; obj -= STRIDE(c)){
+    if(c->ctor)
+      c->ctor(obj);
+    LINK(c, obj) = s->freelist;
+    s->freelist = obj;
+  }
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+  c->nslabs++;
+  return s;
+}
+
+static void
+slab_unlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// Take one object out of a slab.  Caller holds c->lock.
+static void*
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0 && (s = slab_grow(c)) == 0)
+    return 0;
+  obj = s->freelist;
+  s->freelist = LINK(c, obj);
+  s->inuse++;
+  if(s->freelist == 0)
+    slab_unlink(c, s);
+  return obj;
+}
+
+// Return one object to its slab, giving the page back once
+// the slab is empty and the cache has other partial slabs.
+// Caller holds c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("slab_put: wrong cache");
+  if(s->freelist == 0){
+    // Was full, so it is not on the partial list yet.
+    s->prev = 0;
+    s->next = c->partial;
+    if(c->partial)
+      c->partial->prev = s;
+    c->partial = s;
+  }
+  LINK(c, obj) = s->freelist;
+  s->freelist = obj;
+  if(--s->inuse == 0 && (s->prev || s->next)){
+    slab_unlink(c, s);
+    c->nslabs--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate one object from c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj;
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->mag[id].n == 0){
+    acquire(&c->lock);
+    while(c->mag[id].n < MAGSIZE/2 && (obj = slab_get(c)) != 0)
+      c->mag[id].objs[c->mag[id].n++] = obj;
+    c->refills++;
+    release(&c->lock);
+  }
+  obj = 0;
+  if(c->mag[id].n > 0){
+    obj = c->mag[id].objs[--c->mag[id].n];
+    c->mag[id].allocs++;
+  }
+  popcli();
+  return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->mag[id].n == MAGSIZE){
+    acquire(&c->lock);
+    while(c->mag[id].n > MAGSIZE/2)
+      slab_put(c, c->mag[id].objs[--c->mag[id].n]);
+    c->drains++;
+    release(&c->lock);
+  }
+  c->mag[id].objs[c->mag[id].n++] = obj;
+  c->mag[id].frees++;
+  popcli();
+}
+
+// Allocate n bytes from the smallest size class that fits.
+void*
+kmalloc(uint n)
+{
+  int i;
+
+  for(i = 0; i < NELEM(kmalloc_caches); i++)
+    if(n <= (KMALLOC_MIN << i))
+      return kmem_cache_alloc(&kmalloc_caches[i]);
+  panic("kmalloc: too big");
+}
+
+void
+kmfree(void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  kmem_cache_free(s->cache, obj);
+}
+
+// Print every cache's statistics to the console.
+void
+slabdump(void)
+{
+  struct kmem_cache *c;
+  uint allocs, frees;
+  int i;
+
+  acquire(&cachelist.lock);
+  cprintf("\ncache \t\t size \t slabs \t inuse \t allocs \t frees \t refills \t drains\n");
+  for(c = cachelist.head; c; c = c->next){
+    allocs = frees = 0;
+    for(i = 0; i < NCPU; i++){
+      allocs += c->mag[i].allocs;
+      frees += c->mag[i].frees;
+    }
+    cprintf("%s \t %d \t %d \t %d \t %d \t %d \t %d \t %d\n",
+            c->name, c->size, c->nslabs, allocs - frees,
+            allocs, frees, c->refills, c->drains);
+  }
+  release(&cachelist.lock);
+}
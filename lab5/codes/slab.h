@@ -0,0 +1,31 @@
+#ifndef SLAB_H
+#define SLAB_H
+#include "spinlock.h"
+#include "percpu.h"
+
+#define MAGSIZE 16  // objects per per-CPU magazine
+
+// A cache of equally sized kernel objects, carved out of
+// whole pages (slabs).  Each CPU keeps a small magazine of
+// free objects so most allocations skip the cache lock.
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;                // object size, rounded up to 8 bytes
+  void (*ctor)(void*);      // run once on each object of a new slab
+  struct slab *partial;     // slabs with at least one free object
+  struct kmem_cache *next;  // on the list slabdump() walks
+  struct {
+    int n;
+    void *objs[MAGSIZE];
+    uint allocs;            // statistics, summed by slabdump()
+    uint frees;
+  } CACHE_ALIGNED mag[NCPU];
+
+  // Statistics, protected by lock.
+  uint nslabs;              // pages currently held
+  uint refills;             // magazine refills
+  uint drains;              // magazine drains
+};
+
+#endif
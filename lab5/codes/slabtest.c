@@ -0,0 +1,37 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NPIPE 6  // pipes open at once (two fds each, NOFILE is 16)
+#define ROUNDS 100
+
+// Opens and closes batches of pipes, which now come from the
+// "pipe" slab cache instead of a whole page each, then prints
+// every cache's statistics on the console.
+int main(int argc, char *argv[])
+{
+  int fds[NPIPE][2];
+  int i, r;
+
+  printf(1, "Starting slab test\n");
+
+  for (r = 0; r < ROUNDS; r++)
+  {
+    for (i = 0; i < NPIPE; i++)
+    {
+      if (pipe(fds[i]) < 0)
+      {
+        printf(1, "pipe failed\n");
+        exit();
+      }
+    }
+    for (i = 0; i < NPIPE; i++)
+    {
+      close(fds[i][0]);
+      close(fds[i][1]);
+    }
+  }
+
+  slabstat();
+  exit();
+}
@@ -10,38 +10,105 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+// Most pause()s acquiresleep() spins for while the holder is
+// running on another CPU, before it gives up and sleeps.
+#define SLEEPSPIN 4096
+
+// A blocked acquirer, on its own kernel stack.  releasesleep()
+// makes it the owner and wakes just that process.
+struct sleepwait {
+  struct proc *proc;
+  struct sleepwait *next;
+};
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  pi_init(&lk->pi);
+  lk->head = lk->tail = 0;
   lk->pid = 0;
 }
 
+// A holder that is running on some CPU is likely to release
+// the lock sooner than a sleep and wakeup would take, so wait
+// for it in a pause() loop instead.  Returns once the lock
+// looks free, or it is worth blocking after all.
+static void
+spinsleep(struct sleeplock *lk)
+{
+  struct proc *owner;
+  int i;
+
+  for(i = 0; i < SLEEPSPIN; i++){
+    if(*(volatile uint*)&lk->locked == 0)
+      return;
+    // Racy, but only a hint: proc structs are never freed.
+    owner = *(struct proc *volatile*)&lk->pi.owner;
+    if(owner == 0 || owner->state != RUNNING)
+      return;
+    pause();
+  }
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct sleepwait w;
+  struct proc *p = myproc();
+
+  spinsleep(lk);
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  if (!lk->locked) {
+    lk->locked = 1;
+    lk->pi.owner = p;
+    lk->pid = p->pid;
+    release(&lk->lk);
+    return;
+  }
+  // Queue up; the releasing process hands us the lock, so
+  // there is nothing to re-check but that it has.  Until then
+  // the holder runs at our priority if that is better.
+  w.proc = p;
+  w.next = 0;
+  if (lk->tail)
+    lk->tail->next = &w;
+  else
+    lk->head = &w;
+  lk->tail = &w;
+  pi_block(&lk->pi);
+  while (lk->pi.owner != p) {
+    sleep(&w, &lk->lk);
   }
-  lk->locked = 1;
-  lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct sleepwait *w;
+
   acquire(&lk->lk);
 
   if (lk->pid != myproc()->pid)
     panic("releasesleep: not owner");
 
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if ((w = lk->head) != 0) {
+    // Wake-one handoff: the lock stays locked and passes to
+    // the oldest waiter, which no one else can overtake.
+    lk->head = w->next;
+    if (lk->head == 0)
+      lk->tail = 0;
+    pi_handoff(&lk->pi, w->proc);
+    lk->pid = w->proc->pid;
+    wakeup(w);
+  } else {
+    lk->locked = 0;
+    pi_handoff(&lk->pi, 0);
+    lk->pid = 0;
+  }
   release(&lk->lk);
 }
 
@@ -1,8 +1,15 @@
 // Long-term locks for processes
+#include "pi.h"
+
+struct sleepwait;
+
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
-  
+  struct pi pi;       // Holder, for acquirers to spin on, and its waiters
+  struct sleepwait *head;  // Blocked acquirers, oldest first
+  struct sleepwait *tail;
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
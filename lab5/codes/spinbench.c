@@ -0,0 +1,86 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "spinlock.h"
+
+// Spinlock contention benchmark: nproc workers take and release
+// one kernel spinlock of each kind (test-and-set, ticket, MCS)
+// for the same stretch of ticks.  Throughput is acquisitions
+// per tick over all workers; fairness is the fewest one worker
+// got as a share of the most.
+//
+// spinbench [nproc [ticks]]; run it with nproc the number of
+// CPUs, e.g. after make qemu CPUS=2, 4 and 8.
+
+#define MAXWORKER 16
+
+char *kinds[] = {"tas", "ticket", "mcs"};
+
+void run(int type, int nproc, int nticks)
+{
+  int fd[2], count[MAXWORKER], i, n, total, min, max;
+  uint start;
+
+  if (pipe(fd) < 0)
+  {
+    printf(1, "spinbench: pipe failed\n");
+    exit();
+  }
+  // Give every worker time to get going before the start.
+  start = uptime() + 10;
+  for (i = 0; i < nproc; i++)
+  {
+    if (fork() == 0)
+    {
+      close(fd[0]);
+      n = lockbench(type, start, start + nticks);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+  total = max = 0;
+  min = -1;
+  for (i = 0; i < nproc; i++)
+  {
+    if (read(fd[0], &count[i], sizeof(count[i])) != sizeof(count[i]))
+      count[i] = 0;
+    total += count[i];
+    if (count[i] > max)
+      max = count[i];
+    if (min < 0 || count[i] < min)
+      min = count[i];
+  }
+  close(fd[0]);
+  for (i = 0; i < nproc; i++)
+    wait();
+
+  printf(1, "%s\t%d\t\t%d\t%d\t%d%%\t", kinds[type], total / nticks,
+         min, max, max ? min * 100 / max : 0);
+  for (i = 0; i < nproc; i++)
+    printf(1, " %d", count[i]);
+  printf(1, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int nproc, nticks, type;
+
+  nproc = 4;
+  nticks = 100;
+  if (argc > 1)
+    nproc = atoi(argv[1]);
+  if (argc > 2)
+    nticks = atoi(argv[2]);
+  if (nproc < 1 || nproc > MAXWORKER || nticks < 1)
+  {
+    printf(1, "usage: spinbench [nproc [ticks]]\n");
+    exit();
+  }
+
+  printf(1, "%d workers, %d ticks per lock\n", nproc, nticks);
+  printf(1, "lock\tacq/tick\tmin\tmax\tfair\tper worker\n");
+  for (type = LOCK_TAS; type <= LOCK_MCS; type++)
+    run(type, nproc, nticks);
+  exit();
+}
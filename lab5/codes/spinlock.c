@@ -8,20 +8,199 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+#include "percpu.h"
 
 extern struct cpu cpus[NCPU];
 
+#define NMCS 4  // MCS locks one CPU may hold or wait for at once
+
+static struct mcsnode mcsnodes[NCPU][NMCS];
+
+#ifdef LOCKPROF
+// Lock profiling.  initlock() files each lock under its name
+// (NLOCKPROF names at most), and while profiling is on every
+// acquire() and release() adds to that name's counters, and to
+// those of the callsite.  Counters are kept per CPU, so they
+// need no lock: each CPU only adds to its own, with interrupts
+// off.
+struct lockprof {
+  char *name;
+  uint nlocks;
+  uint pc[NLOCKSITE];
+};
+
+static struct {
+  uint busy;      // guards registering; acquire() needs mycpu()
+  struct lockprof prof[NLOCKPROF];
+} lockprofs;
+
+// One CPU's counters for every name in lockprofs.
+struct lockcpu {
+  struct lockcount all[NLOCKPROF];
+  struct lockcount site[NLOCKPROF][NLOCKSITE];
+};
+static DEFINE_PERCPU(struct lockcpu, lockcounts);
+
+#define LOCKALL(lp, cpu)  (&per_cpu(lockcounts, cpu).all[(lp) - lockprofs.prof])
+#define LOCKSITE(lp, cpu, i) (&per_cpu(lockcounts, cpu).site[(lp) - lockprofs.prof][i])
+
+static int lockprof_on = 1;
+
+static struct lockprof*
+lockprof_register(char *name)
+{
+  struct lockprof *lp, *unused;
+
+  while(xchg(&lockprofs.busy, 1) != 0)
+    pause();
+  unused = 0;
+  for(lp = lockprofs.prof; lp < &lockprofs.prof[NLOCKPROF]; lp++){
+    if(lp->name == 0){
+      if(unused == 0)
+        unused = lp;
+    } else if(lp->name == name || strncmp(lp->name, name, 16) == 0)
+      break;
+  }
+  if(lp == &lockprofs.prof[NLOCKPROF] && (lp = unused) != 0)
+    lp->name = name;
+  if(lp)
+    lp->nlocks++;
+  xchg(&lockprofs.busy, 0);
+  return lp;
+}
+
+// The callsite slot for pc, claiming a free one if need be.
+// NLOCKSITE if they are all taken.
+static int
+lockprof_site(struct lockprof *lp, uint pc)
+{
+  int i;
+
+  for(i = 0; i < NLOCKSITE; i++){
+    if(lp->pc[i] == pc)
+      return i;
+    if(lp->pc[i] == 0 && cmpxchg(&lp->pc[i], 0, pc) == 0)
+      return i;
+    // Another CPU may just have claimed it for the same pc.
+    if(lp->pc[i] == pc)
+      return i;
+  }
+  return NLOCKSITE;
+}
+
+static void
+lockcount_add(struct lockcount *c, uint spin)
+{
+  c->acq++;
+  if(spin){
+    c->contended++;
+    c->spin += spin;
+  }
+}
+#endif
+
 void
 initlock(struct spinlock *lk, char *name)
+{
+  initlock_type(lk, name, LOCK_TICKET);
+}
+
+// Initialize lk as a lock of the given kind (LOCK_* in spinlock.h).
+// Ticket and MCS locks hand the lock over in the order CPUs asked
+// for it; MCS also has each waiter spin on a cache line of its
+// own, so a release only disturbs the next CPU in line.
+void
+initlock_type(struct spinlock *lk, char *name, int type)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->type = type;
+  lk->next = lk->owner = 0;
+  lk->tail = lk->mcs = 0;
+#ifdef LOCKPROF
+  lk->prof = lockprof_register(name);
+  lk->profiled = 0;
+#endif
+}
+
+// Spin on a plain read and only retry the xchg once the lock
+// looks free, so waiters do not keep stealing the cache line.
+static uint64
+tas_acquire(struct spinlock *lk)
+{
+  uint64 spins = 0;
+
+  while(xchg(&lk->locked, 1) != 0){
+    while(*(volatile uint*)&lk->locked){
+      pause();
+      spins++;
+    }
+  }
+  return spins;
+}
+
+static uint64
+ticket_acquire(struct spinlock *lk)
+{
+  uint64 spins = 0;
+  uint t;
+
+  t = xadd(&lk->next, 1);
+  while(lk->owner != t){
+    pause();
+    spins++;
+  }
+  return spins;
+}
+
+// Queue one of this CPU's nodes at the tail of lk's waiters and
+// spin on it until the holder ahead of us clears its wait flag.
+static uint64
+mcs_acquire(struct spinlock *lk, int id)
+{
+  struct mcsnode *n, *prev;
+  uint64 spins = 0;
   int i;
-  for(i = 0; i < NCPU; i++){
-    lk->acq_count[i] = 0;
-    lk->total_spins[i] = 0;
+
+  for(i = 0; i < NMCS && mcsnodes[id][i].busy; i++)
+    ;
+  if(i == NMCS)
+    panic("acquire: out of mcs nodes");
+  n = &mcsnodes[id][i];
+  n->busy = 1;
+  n->next = 0;
+  n->wait = 1;
+  prev = (struct mcsnode*)xchg((volatile uint*)&lk->tail, (uint)n);
+  if(prev){
+    prev->next = n;
+    while(n->wait){
+      pause();
+      spins++;
+    }
   }
+  lk->mcs = n;
+  return spins;
+}
+
+static void
+mcs_release(struct spinlock *lk)
+{
+  struct mcsnode *n = lk->mcs;
+
+  if(n->next == 0){
+    // Nobody behind us, unless a CPU is between its xchg on
+    // the tail and linking itself in: then wait for the link.
+    if(cmpxchg((volatile uint*)&lk->tail, (uint)n, 0) == (uint)n){
+      n->busy = 0;
+      return;
+    }
+    while(n->next == 0)
+      pause();
+  }
+  n->next->wait = 0;
+  n->busy = 0;
 }
 
 // Acquire the lock.
@@ -31,21 +210,32 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins;
+  int cpu_id;
+#ifdef LOCKPROF
+  struct lockprof *lp;
+  uint t0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  uint64 spins = 0; // Local counter for spins
-
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    spins++; // Increment local spin counter
-
-  // Record stats after acquiring
-  int cpu_id = mycpu() - cpus; // Get current CPU index (0 to NCPU-1)
-  lk->acq_count[cpu_id]++;
-  lk->total_spins[cpu_id] += spins;
-  // --------------------------
+  cpu_id = cpuid(); // Get current CPU index (0 to NCPU-1)
+#ifdef LOCKPROF
+  lp = lockprof_on ? lk->prof : 0;
+  t0 = lp ? rdtsc() : 0;
+#endif
+  if(lk->type == LOCK_TICKET)
+    spins = ticket_acquire(lk);
+  else if(lk->type == LOCK_MCS)
+    spins = mcs_acquire(lk, cpu_id);
+  else
+    spins = tas_acquire(lk);
+  lk->locked = 1;
+#ifndef LOCKPROF
+  (void)spins;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point...
@@ -53,7 +243,17 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
-  getcallerpcs(&lk, lk->pcs);
+
+#ifdef LOCKPROF
+  lk->profiled = lp != 0;
+  if(lp){
+    lk->tstart = rdtsc();
+    lk->site = lockprof_site(lp, (uint)__builtin_return_address(0));
+    lockcount_add(LOCKALL(lp, cpu_id), spins ? lk->tstart - t0 : 0);
+    if(lk->site < NLOCKSITE)
+      lockcount_add(LOCKSITE(lp, cpu_id, lk->site), spins ? lk->tstart - t0 : 0);
+  }
+#endif
 }
 
 // Release the lock.
@@ -63,7 +263,18 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
-  lk->pcs[0] = 0;
+#ifdef LOCKPROF
+  if(lk->profiled){
+    struct lockprof *lp = lk->prof;
+    int cpu_id = cpuid();
+    uint held = (uint)rdtsc() - lk->tstart;
+
+    LOCKALL(lp, cpu_id)->hold += held;
+    if(lk->site < NLOCKSITE)
+      LOCKSITE(lp, cpu_id, lk->site)->hold += held;
+    lk->profiled = 0;
+  }
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -76,7 +287,13 @@ release(struct spinlock *lk)
   // Release the lock, equivalent to lk->locked = 0.
   // This code can't use a C assignment, since it might
   // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // For ticket and MCS locks this only clears the flag
+  // holding() looks at; the hand-over comes after it.
+  asm volatile("movl $0, %0" : "+m" (lk->locked) : : "memory");
+  if(lk->type == LOCK_TICKET)
+    lk->owner++;  // only the holder writes owner
+  else if(lk->type == LOCK_MCS)
+    mcs_release(lk);
 
   popcli();
 }
@@ -138,3 +355,127 @@ popcli(void)
     sti();
 }
 
+
+// Turn lock profiling on or off (LOCKPROF_ON, LOCKPROF_OFF), or
+// clear the counters (LOCKPROF_RESET).  Returns whether it was
+// on, or -1 if the kernel was built without LOCKPROF.
+int
+lockprof(int cmd)
+{
+#ifdef LOCKPROF
+  struct lockprof *lp;
+  int old = lockprof_on;
+  int i;
+
+  if(cmd == LOCKPROF_RESET){
+    for(lp = lockprofs.prof; lp < &lockprofs.prof[NLOCKPROF]; lp++)
+      memset(lp->pc, 0, sizeof(lp->pc));
+    for(i = 0; i < NCPU; i++)
+      memset(&per_cpu(lockcounts, i), 0, sizeof(struct lockcpu));
+  } else if(cmd == LOCKPROF_ON || cmd == LOCKPROF_OFF)
+    lockprof_on = cmd == LOCKPROF_ON;
+  else
+    return -1;
+  return old;
+#else
+  return -1;
+#endif
+}
+
+#ifdef LOCKPROF
+static void
+lockcount_sum(struct lockcount *sum, struct lockcount *c)
+{
+  sum->acq += c->acq;
+  sum->contended += c->contended;
+  sum->spin += c->spin;
+  sum->hold += c->hold;
+}
+#endif
+
+// Copy out the profiles of up to n lock names, summed over
+// all CPUs.  Returns how many, or -1 without LOCKPROF.
+int
+lockprof_stat(struct lockstat *ls, int n)
+{
+#ifdef LOCKPROF
+  struct lockprof *lp;
+  int i, j, k;
+
+  k = 0;
+  for(lp = lockprofs.prof; lp < &lockprofs.prof[NLOCKPROF] && k < n; lp++){
+    if(lp->name == 0)
+      continue;
+    memset(&ls[k], 0, sizeof(ls[k]));
+    safestrcpy(ls[k].name, lp->name, sizeof(ls[k].name));
+    ls[k].nlocks = lp->nlocks;
+    for(i = 0; i < NCPU; i++)
+      lockcount_sum(&ls[k].all, LOCKALL(lp, i));
+    for(j = 0; j < NLOCKSITE; j++){
+      ls[k].site[j].pc = lp->pc[j];
+      for(i = 0; i < NCPU; i++)
+        lockcount_sum(&ls[k].site[j].n, LOCKSITE(lp, i, j));
+    }
+    k++;
+  }
+  return k;
+#else
+  return -1;
+#endif
+}
+
+// Fill lc[NCPU] with lk's per-CPU counters (those of all locks
+// sharing its name).  Returns 0, or -1 without LOCKPROF, when
+// they are all zero.
+int
+lockprof_percpu(struct spinlock *lk, struct lockcount *lc)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    memset(&lc[i], 0, sizeof(lc[i]));
+#ifdef LOCKPROF
+    if(lk->prof)
+      lc[i] = *LOCKALL(lk->prof, i);
+#endif
+  }
+#ifdef LOCKPROF
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+// Contention benchmark, see spinbench.c.  Every CPU calling
+// lockbench() at once hammers one lock of the given kind with
+// a short critical section that dirties a few cache lines.
+#define NBENCH 4
+
+static struct spinlock benchlk[] = {
+  [LOCK_TAS] = { .name = "bench tas", .type = LOCK_TAS },
+  [LOCK_TICKET] = { .name = "bench ticket", .type = LOCK_TICKET },
+  [LOCK_MCS] = { .name = "bench mcs", .type = LOCK_MCS },
+};
+static uint benchdata[NBENCH * 16];
+
+// Wait for tick start, then take and release the lock until
+// tick end.  Returns how often this caller got it, or -1.
+int
+lockbench(int type, uint start, uint end)
+{
+  struct spinlock *lk;
+  int i, n;
+
+  if(type < LOCK_TAS || type > LOCK_MCS || end < start)
+    return -1;
+  lk = &benchlk[type];
+  while(*(volatile uint*)&ticks < start)
+    pause();
+  for(n = 0; *(volatile uint*)&ticks < end; n++){
+    acquire(lk);
+    for(i = 0; i < NBENCH; i++)
+      benchdata[i * 16]++;
+    release(lk);
+  }
+  return n;
+}
@@ -2,31 +2,38 @@
 #define SPINLOCK_H
 #include "types.h"
 #include "param.h"
+// Kinds of spinlock, chosen with initlock_type().
+#define LOCK_TAS     0  // test-and-set on locked
+#define LOCK_TICKET  1  // FIFO tickets: next handed out, owner served
+#define LOCK_MCS     2  // FIFO queue, each waiter spins on its own node
+
+// An MCS waiter.  Each CPU has NMCS of them (spinlock.c), one for
+// every MCS lock it may hold or wait for at the same time.
+struct mcsnode {
+  struct mcsnode *volatile next;  // waiter queued behind this one
+  volatile uint wait;             // cleared by the holder ahead of us
+  uint busy;                      // in use by this CPU
+} __attribute__((aligned(64)));
+
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+  int type;          // LOCK_TAS, LOCK_TICKET or LOCK_MCS
+  volatile uint next;   // LOCK_TICKET: next ticket to hand out
+  volatile uint owner;  // LOCK_TICKET: ticket being served
+  struct mcsnode *volatile tail;  // LOCK_MCS: last waiter, or 0
+  struct mcsnode *mcs;  // LOCK_MCS: the holder's node
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-  uint pcs[10];      // The call stack (an array of program counters)
-                     // that locked the lock.
-
-  uint64 acq_count[NCPU];   // Times lock acquired on each CPU
-  uint64 total_spins[NCPU]; // Total spin cycles on each CPU
-};
-
-struct plock_node {
-  struct proc *proc;       
-  int priority;            
-  struct plock_node *next; 
-};
 
-struct plock {
-  struct spinlock lk;      
-  int locked;  
-  struct plock_node *head; 
-  char *name;              
+#ifdef LOCKPROF
+  struct lockprof *prof;  // Shared by all locks of this name, or 0
+  uint tstart;       // Low rdtsc bits when the current hold began
+  uchar profiled;    // Is the current hold being timed?
+  uchar site;        // Its slot in prof's callsites, NLOCKSITE if none
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,395 @@
+// Swap space, so user memory can outgrow physical memory.
+//
+// mkfs reserves sb.nswap blocks after the file system; each
+// page-sized run of them is a slot.  When kalloc() runs dry,
+// swapalloc() asks swapout() (proc.c) to push some process's
+// page out to a slot.  The page's PTE keeps its flags but has
+// PTE_P cleared, PTE_SWAP set and the slot number in place of
+// the frame address, so the next touch faults into swapin().
+//
+// A PTE is switched to its slot before the page is written,
+// while the slot is SLOT_WRITING; a fault on it in the meantime
+// waits for the write instead of reading a half-written slot.
+// Pages that a system call may touch while holding a spinlock
+// are pinned by argptr() and never chosen.
+//
+// A page read back from swap keeps its slot (frame->swapslot)
+// until it is written to, so evicting it again while PTE_D is
+// still clear needs no disk write.  Those slots are taken back
+// when the swap area fills up.
+//
+// zram.c keeps a compressed copy of a page in memory where it
+// can, and the disk only sees the pages it cannot keep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "frame.h"
+
+#define SPP     (PGSIZE/BSIZE)  // swap blocks per page
+#define NSLOT   (SWAPSIZE/SPP)
+
+enum { SLOT_FREE, SLOT_USED, SLOT_WRITING, SLOT_DEAD };
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;         // first swap block on dev
+  uint nslot;         // usable slots, 0 if the disk has no swap area
+  uint nused;
+  uint next;          // where slotalloc() starts looking
+  uint steal;         // next frame slotalloc() takes a clean slot from
+  uchar state[NSLOT];
+  uint nout;          // pages written to swap
+  uint nin;           // pages read back
+} swap;
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / SPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+  zraminit(swap.nslot);
+}
+
+// Find a free slot and mark it SLOT_WRITING.  If there is none,
+// take one that a resident page is keeping a clean copy in.
+// Caller holds swap.lock.
+static int
+slotalloc(void)
+{
+  struct frame *f;
+  uint i, s;
+
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.state[s] == SLOT_FREE){
+      swap.state[s] = SLOT_WRITING;
+      swap.nused++;
+      swap.next = s + 1;
+      return s;
+    }
+  }
+  for(i = 0; i < NFRAME; i++){
+    f = &frames[(swap.steal + i) % NFRAME];
+    if(f->swapslot){
+      s = f->swapslot - 1;
+      f->swapslot = 0;
+      swap.state[s] = SLOT_WRITING;
+      swap.steal = f - frames + 1;
+      return s;
+    }
+  }
+  return -1;
+}
+
+// Transfer one page between mem and slot through a private
+// buffer, bypassing the block cache: swap blocks are never
+// shared, and caching them would only push out file blocks.
+static void
+swaprw(int slot, char *mem, int write)
+{
+  struct buf b;
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  initsleeplock(&b.lock, "swapbuf");
+  acquiresleep(&b.lock);
+  b.dev = swap.dev;
+  for(i = 0; i < SPP; i++){
+    b.blockno = swap.start + slot*SPP + i;
+    if(write){
+      memmove(b.data, mem + i*BSIZE, BSIZE);
+      b.flags = B_DIRTY;
+    } else
+      b.flags = 0;
+    iderw(&b);
+    if(!write)
+      memmove(mem + i*BSIZE, b.data, BSIZE);
+  }
+  releasesleep(&b.lock);
+}
+
+// Wait until the page in slot has finished going out.
+// Caller holds swap.lock.
+static void
+slotwait(uint slot)
+{
+  while(swap.state[slot] == SLOT_WRITING)
+    sleep(&swap.state[slot], &swap.lock);
+}
+
+// Allocate a page like kalloc(), or kalloc_zeroed() if zero is set,
+// evicting user pages to swap while memory is exhausted.  color is
+// the page colour wanted (see uvmcolor()), or -1.  May sleep, so
+// the caller must not hold any spinlock.
+char*
+swapalloc(int zero, int color)
+{
+  char *mem;
+
+  for(;;){
+    if((mem = zero ? kalloc_color_zeroed(color) : kalloc_color(color)) != 0)
+      return mem;
+    if(swap.nslot == 0 || !swapout())
+      return 0;
+  }
+}
+
+// Called by swapout() with ptable.lock held, once the policy
+// has picked f, a resident page of p, which is not running on
+// any other CPU.  Moves the PTE to a swap slot and takes f
+// away from the policy.  Returns the slot, with *write set if
+// the page still has to be written there, or -1 if swap is full.
+// A page madvise(MADV_FREE) gave up and that is still clean
+// needs no slot: it is dropped, with *write clear.
+int
+swapmark(struct proc *p, struct frame *f, int *write)
+{
+  pte_t *pte;
+  int slot;
+
+  pte = walkpgdir(f->pgdir, (char*)FRAMEVA(f), 0);
+  if((*pte & (PTE_LAZY|PTE_D)) == PTE_LAZY){
+    *pte = (PTE_FLAGS(*pte) & (PTE_W|PTE_U)) | PTE_LAZY;
+    if(p == myproc())
+      invlpg((void*)FRAMEVA(f));
+    frame_remove(f->pgdir, FRAME2PA(f));
+    *write = 0;
+    return 0;
+  }
+  acquire(&swap.lock);
+  if(f->swapslot && (*pte & PTE_D) == 0){
+    slot = f->swapslot - 1;
+    *write = 0;
+  } else if(f->swapslot){
+    slot = f->swapslot - 1;
+    swap.state[slot] = SLOT_WRITING;
+    *write = 1;
+  } else {
+    slot = slotalloc();
+    *write = 1;
+  }
+  f->swapslot = 0;
+  release(&swap.lock);
+  if(slot < 0)
+    return -1;
+
+  *pte = (slot << PTXSHIFT) |
+         (PTE_FLAGS(*pte) & ~(PTE_P|PTE_A|PTE_D|PTE_LAZY)) | PTE_SWAP;
+  if(p == myproc())
+    invlpg((void*)FRAMEVA(f));
+  frame_evict(f, *write);
+  return slot;
+}
+
+// Write the page that swapmark() took out to its slot, or to
+// the compressed cache.  Returns 1 if the cache took mem itself
+// as a pool page, so the caller must not free it.
+int
+swapwrite(int slot, char *mem)
+{
+  int r;
+
+  if((r = zram_store(slot, mem)) < 0)
+    swaprw(slot, mem, 1);
+
+  acquire(&swap.lock);
+  if(r < 0)
+    swap.nout++;
+  if(swap.state[slot] == SLOT_DEAD){
+    // Its owner let go of it while it was being written.
+    swap.state[slot] = SLOT_FREE;
+    swap.nused--;
+    zram_drop(slot);
+  } else
+    swap.state[slot] = SLOT_USED;
+  wakeup(&swap.state[slot]);
+  release(&swap.lock);
+  return r == 1;
+}
+
+// Copy the page behind a PTE_SWAP entry into mem, leaving the
+// slot in use.  Returns 1 if it came from the compressed cache.
+int
+swapread(pte_t pte, char *mem)
+{
+  uint slot = PTE_SLOT(pte);
+
+  acquire(&swap.lock);
+  slotwait(slot);
+  release(&swap.lock);
+  if(zram_load(slot, mem) == 0)
+    return 1;
+  swaprw(slot, mem, 0);
+  return 0;
+}
+
+// Bring page va of p (the current process) back from swap.
+// Returns -1 if it is not in swap or no memory can be found.
+int
+swapin(struct proc *p, uint va)
+{
+  pte_t *pte, old;
+  char *mem;
+  int cached;
+
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & PTE_SWAP) == 0)
+    return -1;
+  // Only p itself changes a PTE_SWAP entry, so *pte still
+  // names the same slot after swapalloc() has evicted pages.
+  if((mem = swapalloc(0, uvmcolor(p->pgdir, va))) == 0)
+    return -1;
+  old = *pte;
+  cached = swapread(old, mem);
+  *pte = V2P(mem) | (PTE_FLAGS(old) & ~PTE_SWAP) | PTE_P;
+  frame_insert(p->pgdir, va, V2P(mem), 1);
+
+  if(cached)
+    p->minflt++;
+  else
+    p->majflt++;
+
+  acquire(&swap.lock);
+  if(cached){
+    // A compressed copy costs memory, and making a new one
+    // later is cheap, so let it go.
+    swap.state[PTE_SLOT(old)] = SLOT_FREE;
+    swap.nused--;
+    zram_drop(PTE_SLOT(old));
+  } else {
+    // The slot stays as a clean copy until the page is dirtied.
+    PA2FRAME(V2P(mem))->swapslot = PTE_SLOT(old) + 1;
+  }
+  swap.nin++;
+  release(&swap.lock);
+  return 0;
+}
+
+// Handle a page fault in the current process by bringing the
+// page back from swap.  Returns -1 if the fault is not for a
+// swapped-out page, or comes from kernel code that cannot
+// sleep, so trap() can treat it as it always has.
+int
+swapfault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va = rcr2(), t0;
+  pte_t *pte;
+  int r;
+
+  if(p == 0 || va >= p->sz)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & PTE_SWAP) == 0)
+    return -1;
+  if((tf->cs&3) == 0 && (mycpu()->ncli > 0 || (tf->eflags & FL_IF) == 0))
+    return -1;
+  // The disk interrupt has to get through while we wait;
+  // the rest of trap() expects them off again.
+  sti();
+  // The PFF controller holds a thrashing process back, so the
+  // frames it would take stay with the others a little longer.
+  if(p->thrashing){
+    acquire(&tickslock);
+    t0 = ticks;
+    while(ticks - t0 < PFFDELAY && !p->killed)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+  }
+  if((r = swapin(p, PGROUNDDOWN(va))) == 0)
+    seqfault(p, PGROUNDDOWN(va));
+  cli();
+  return r;
+}
+
+// Release the slot behind a PTE_SWAP entry.
+void
+swapfree(pte_t pte)
+{
+  uint slot = PTE_SLOT(pte);
+
+  acquire(&swap.lock);
+  if(swap.state[slot] == SLOT_WRITING)
+    swap.state[slot] = SLOT_DEAD;  // swapwrite() frees it
+  else if(swap.state[slot] == SLOT_USED){
+    swap.state[slot] = SLOT_FREE;
+    swap.nused--;
+    zram_drop(slot);
+  } else
+    panic("swapfree");
+  release(&swap.lock);
+}
+
+// f is being freed: drop the clean copy it kept in swap, if any.
+void
+swapdrop(struct frame *f)
+{
+  uint slot;
+
+  acquire(&swap.lock);
+  if(f->swapslot){
+    slot = f->swapslot - 1;
+    f->swapslot = 0;
+    swap.state[slot] = SLOT_FREE;
+    swap.nused--;
+    zram_drop(slot);
+  }
+  release(&swap.lock);
+}
+
+// Keep the user buffer [va, va+n) of the current system call
+// in memory until the call returns, reading back any part of it
+// that is in swap.  Kernel code such as piperead() touches such
+// buffers with a spinlock held, where a fault could not sleep.
+// Pages merged by ksm.c are made private again, and dropped
+// ones zero-filled, because the kernel's writes would not fault.
+void
+swappin(uint va, uint n)
+{
+  struct proc *p = myproc();
+  uint a;
+
+  if(n == 0)
+    return;
+  // Only p changes its pins, and swapout() and ksm.c only look
+  // at them while p is not running, so no lock is needed.
+  if(p->npin < NELEM(p->pin)){
+    p->pin[p->npin].lo = va;
+    p->pin[p->npin].hi = va + n;
+    p->npin++;
+  } else {
+    // Out of ranges: pin everything.
+    p->pin[p->npin-1].lo = 0;
+    p->pin[p->npin-1].hi = KERNBASE;
+  }
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+    uvmtouch(p, a);
+}
+
+void
+swapdump(void)
+{
+  acquire(&swap.lock);
+  cprintf("swap: %d/%d pages used, %d out, %d in\n",
+          swap.nused, swap.nslot, swap.nout, swap.nin);
+  release(&swap.lock);
+}
@@ -0,0 +1,77 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define MB (1024 * 1024)
+
+// Write a word per 1KB of every page, tagged with who wrote it.
+void fill(char *mem, int npages, int tag)
+{
+  int i, j;
+
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE; j += 1024)
+      *(int *)(mem + i * PGSIZE + j) = (i << 8) ^ tag ^ j;
+}
+
+// Returns the number of words that do not hold what fill() wrote.
+int check(char *mem, int npages, int tag)
+{
+  int i, j, bad;
+
+  bad = 0;
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE; j += 1024)
+      if (*(int *)(mem + i * PGSIZE + j) != ((i << 8) ^ tag ^ j))
+        bad++;
+  return bad;
+}
+
+// Grow past physical memory (PHYSTOP is 224MB) so pages have to
+// go out to swap, first with sbrk() in one process and then with
+// fork() doubling the footprint.
+int main(int argc, char *argv[])
+{
+  int mb, npages, t0, pid, bad;
+  char *mem;
+
+  mb = 128;
+  if (argc > 1)
+    mb = atoi(argv[1]);
+  npages = mb * (MB / PGSIZE);
+
+  printf(1, "swaptest: %d MB\n", mb);
+  t0 = uptime();
+  mem = sbrk(npages * PGSIZE);
+  if (mem == (char *)-1)
+  {
+    printf(1, "swaptest: sbrk failed\n");
+    exit();
+  }
+  fill(mem, npages, 0x11);
+  bad = check(mem, npages, 0x11);
+  printf(1, "sbrk: %d bad words, %d ticks\n", bad, uptime() - t0);
+
+  t0 = uptime();
+  pid = fork();
+  if (pid < 0)
+  {
+    printf(1, "swaptest: fork failed\n");
+    exit();
+  }
+  if (pid == 0)
+  {
+    bad = check(mem, npages, 0x11);
+    fill(mem, npages, 0x22);
+    bad += check(mem, npages, 0x22);
+    printf(1, "child: %d bad words\n", bad);
+    exit();
+  }
+  wait();
+  bad = check(mem, npages, 0x11);
+  printf(1, "parent: %d bad words, %d ticks\n", bad, uptime() - t0);
+
+  print_stats();
+  exit();
+}
@@ -0,0 +1,80 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// Syscall-heavy ping-pong between two processes.  Every round trip
+// forces two context switches, and each side then makes a burst of
+// system calls whose kernel translations either survived the switch
+// (PTE_G) or must be refilled from the page tables.  A second phase
+// times sbrk() grow/shrink pairs, which no longer reload %cr3.
+
+#define ROUNDS 2000
+#define BURST 20
+#define SBRKS 20000
+
+void burst(void)
+{
+  int i;
+
+  for (i = 0; i < BURST; i++)
+    getpid();
+}
+
+int main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  uint64 t0, t1;
+  char c = 0;
+  int i, pid;
+
+  printf(1, "Starting switch test\n");
+
+  if (pipe(ping) < 0 || pipe(pong) < 0)
+  {
+    printf(1, "pipe failed\n");
+    exit();
+  }
+
+  pid = fork();
+  if (pid < 0)
+  {
+    printf(1, "fork failed\n");
+    exit();
+  }
+
+  if (pid == 0)
+  {
+    for (i = 0; i < ROUNDS; i++)
+    {
+      read(ping[0], &c, 1);
+      burst();
+      write(pong[1], &c, 1);
+    }
+    exit();
+  }
+
+  t0 = rdtsc();
+  for (i = 0; i < ROUNDS; i++)
+  {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+    burst();
+  }
+  t1 = rdtsc();
+  wait();
+  printf(1, "round trip: %d cycles (%d syscalls each)\n",
+         (uint)((t1 - t0) >> 4) / (ROUNDS >> 4), 2 * BURST + 4);
+
+  t0 = rdtsc();
+  for (i = 0; i < SBRKS; i++)
+  {
+    sbrk(4096);
+    sbrk(-4096);
+  }
+  t1 = rdtsc();
+  printf(1, "sbrk grow+shrink: %d cycles\n",
+         (uint)((t1 - t0) >> 5) / (SBRKS >> 5));
+
+  exit();
+}
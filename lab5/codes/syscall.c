@@ -66,6 +66,7 @@ argptr(int n, char **pp, int size)
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
   *pp = (char*)i;
+  swappin(i, size);
   return 0;
 }
 
@@ -125,6 +126,24 @@ extern int sys_rwlock_write_release(void);
 extern int sys_write_page(void);
 extern int sys_read_page(void);
 extern int sys_print_stats(void);
+extern int sys_kallocstat(void);
+extern int sys_slabstat(void);
+extern int sys_buddystat(void);
+extern int sys_buddytest(void);
+extern int sys_setpolicy(void);
+extern int sys_zramstat(void);
+extern int sys_ksmstat(void);
+extern int sys_memstat(void);
+extern int sys_madvise(void);
+extern int sys_setcolor(void);
+extern int sys_lockbench(void);
+extern int sys_lockstat(void);
+extern int sys_lockprof(void);
+extern int sys_rwbench(void);
+extern int sys_rcubench(void);
+extern int sys_plockstat(void);
+extern int sys_futex(void);
+extern int sys_mapshared(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -168,6 +187,24 @@ static int (*syscalls[])(void) = {
 [SYS_write_page] sys_write_page,
 [SYS_read_page] sys_read_page,
 [SYS_print_stats] sys_print_stats,
+[SYS_kallocstat] sys_kallocstat,
+[SYS_slabstat] sys_slabstat,
+[SYS_buddystat] sys_buddystat,
+[SYS_buddytest] sys_buddytest,
+[SYS_setpolicy] sys_setpolicy,
+[SYS_zramstat] sys_zramstat,
+[SYS_ksmstat]  sys_ksmstat,
+[SYS_memstat]  sys_memstat,
+[SYS_madvise]  sys_madvise,
+[SYS_setcolor] sys_setcolor,
+[SYS_lockbench] sys_lockbench,
+[SYS_lockstat]  sys_lockstat,
+[SYS_lockprof]  sys_lockprof,
+[SYS_rwbench]   sys_rwbench,
+[SYS_rcubench]  sys_rcubench,
+[SYS_plockstat] sys_plockstat,
+[SYS_futex]     sys_futex,
+[SYS_mapshared] sys_mapshared,
 
 
 };
@@ -179,6 +216,7 @@ syscall(void)
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
+  curproc->npin = 0;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
   } else {
@@ -40,4 +40,22 @@
 #define SYS_rwlock_write_release  39
 #define SYS_write_page  40
 #define SYS_read_page   41
-#define SYS_print_stats 42
\ No newline at end of file
+#define SYS_print_stats 42
+#define SYS_kallocstat  43
+#define SYS_slabstat    44
+#define SYS_buddystat   45
+#define SYS_buddytest   46
+#define SYS_setpolicy   47
+#define SYS_zramstat   48
+#define SYS_ksmstat    49
+#define SYS_memstat    50
+#define SYS_madvise    51
+#define SYS_setcolor   52
+#define SYS_lockbench  53
+#define SYS_lockstat   54
+#define SYS_lockprof   55
+#define SYS_rwbench    56
+#define SYS_rcubench 57
+#define SYS_plockstat 58
+#define SYS_futex 59
+#define SYS_mapshared 60
\ No newline at end of file
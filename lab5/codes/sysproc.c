@@ -9,6 +9,12 @@
 #include "spinlock.h"
 #include "rwlock.h"
 #include "sleeplock.h"
+#include "kalloc.h"
+#include "zram.h"
+#include "ksm.h"
+#include "memstat.h"
+#include "lockstat.h"
+#include "plockstat.h"
 
 extern struct plock global_plock;
 extern struct rwlock global_rwlock;
@@ -68,8 +74,8 @@ int sys_sleep(void)
 
   if (argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
   ticks0 = ticks;
+  acquire(&tickslock);
   while (ticks - ticks0 < n)
   {
     if (myproc()->killed)
@@ -87,12 +93,7 @@ int sys_sleep(void)
 // since start.
 int sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return ticks;
 }
 
 int sys_simplearith(void)
@@ -140,27 +141,21 @@ int sys_print_process_info(void)
 int sys_getlockstat(void)
 {
   uint64 *score;
-  uint64 kscore[NCPU];
+  struct lockcount lc[NCPU];
   int i;
 
   if (argptr(0, (char **)&score, sizeof(uint64) * NCPU) < 0)
     return -1;
 
+  // Average cycles spent waiting per acquisition of tickslock.
+  if (lockprof_percpu(&tickslock, lc) < 0)
+    return -1;
   for (i = 0; i < NCPU; i++)
   {
-    if (tickslock.acq_count[i] > 0)
-    {
-      kscore[i] = (uint)tickslock.total_spins[i] / (uint)tickslock.acq_count[i];
-    }
+    if (lc[i].acq > 0)
+      score[i] = (uint)lc[i].spin / lc[i].acq;
     else
-    {
-      kscore[i] = 0;
-    }
-  }
-
-  for (i = 0; i < NCPU; i++)
-  {
-    score[i] = kscore[i];
+      score[i] = 0;
   }
 
   return 0;
@@ -178,8 +173,7 @@ int sys_plock_acquire(void)
 
 int sys_plock_release(void)
 {
-  plock_release(&global_plock);
-  return 0;
+  return plock_release(&global_plock);
 }
 
 void ensure_testlock_init(void)
@@ -255,3 +249,208 @@ int sys_read_page(void)
 
   return handle_paging_request(addr, 0, 0);
 }
+
+int sys_print_stats(void)
+{
+  print_paging_stats();
+  return 0;
+}
+
+int sys_kallocstat(void)
+{
+  struct kallocstat *ks;
+
+  if (argptr(0, (char **)&ks, sizeof(*ks) * NCPU) < 0)
+    return -1;
+  kallocstat(ks);
+  return 0;
+}
+
+int sys_slabstat(void)
+{
+  slabdump();
+  return 0;
+}
+
+int sys_buddystat(void)
+{
+  kallocdump();
+  return 0;
+}
+
+int sys_buddytest(void)
+{
+  return buddy_test();
+}
+
+// Select the page replacement policy (POLICY_* in repl.h).
+// Returns the previous one.
+int sys_setpolicy(void)
+{
+  int n;
+
+  if (argint(0, &n) < 0)
+    return -1;
+  return frame_setpolicy(n);
+}
+
+// Copy out the compressed swap cache's counters.
+int sys_zramstat(void)
+{
+  struct zramstat *st;
+
+  if (argptr(0, (char **)&st, sizeof(*st)) < 0)
+    return -1;
+  zram_stat(st);
+  return 0;
+}
+
+// Copy out the same-page merger's counters.
+int sys_ksmstat(void)
+{
+  struct ksmstat *st;
+
+  if (argptr(0, (char **)&st, sizeof(*st)) < 0)
+    return -1;
+  ksm_stat(st);
+  return 0;
+}
+
+// Copy out the memory counters of up to n processes.
+// Returns how many there were.
+int sys_memstat(void)
+{
+  struct memstat *ms;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0 || n > NPROC)
+    return -1;
+  if (argptr(0, (char **)&ms, n * sizeof(*ms)) < 0)
+    return -1;
+  return procmemstat(ms, n);
+}
+
+// madvise(addr, len, advice): tell the kernel how the pages
+// [addr, addr+len) will be used (MADV_* in madvise.h).
+int sys_madvise(void)
+{
+  struct proc *curproc = myproc();
+  int addr, len, advice;
+
+  if (argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if ((uint)addr % PGSIZE || len < 0 || (uint)addr + len > curproc->sz ||
+      (uint)addr + len < (uint)addr)
+    return -1;
+  return uvmadvise(curproc, addr, len, advice);
+}
+
+// Turn page colouring of user memory on or off.
+// Returns the previous setting.
+int sys_setcolor(void)
+{
+  int on;
+
+  if (argint(0, &on) < 0)
+    return -1;
+  return kalloc_setcolor(on);
+}
+
+// lockbench(type, start, end): take a spinlock of the given kind
+// (LOCK_* in spinlock.h) from tick start to tick end.  Returns
+// how many times this process got it.
+int sys_lockbench(void)
+{
+  int type, start, end;
+
+  if (argint(0, &type) < 0 || argint(1, &start) < 0 || argint(2, &end) < 0)
+    return -1;
+  return lockbench(type, start, end);
+}
+
+// lockstat(ls, n): copy out the profiles of up to n lock names.
+// Returns how many there were.
+int sys_lockstat(void)
+{
+  struct lockstat *ls;
+  int n;
+
+  if (argint(1, &n) < 0 || n < 0)
+    return -1;
+  // Bound n first, or n * sizeof(*ls) could wrap past argptr().
+  if (n > NLOCKPROF)
+    n = NLOCKPROF;
+  if (argptr(0, (char **)&ls, n * sizeof(*ls)) < 0)
+    return -1;
+  return lockprof_stat(ls, n);
+}
+
+// lockprof(cmd): LOCKPROF_ON, LOCKPROF_OFF or LOCKPROF_RESET.
+// Returns whether profiling was on.
+int sys_lockprof(void)
+{
+  int cmd;
+
+  if (argint(0, &cmd) < 0)
+    return -1;
+  return lockprof(cmd);
+}
+
+// rwbench(writepct, start, end): take a reader-writer lock from
+// tick start to tick end, for writing writepct percent of the
+// time.  Returns how many times this process got it.
+int sys_rwbench(void)
+{
+  int writepct, start, end;
+
+  if (argint(0, &writepct) < 0 || argint(1, &start) < 0 || argint(2, &end) < 0)
+    return -1;
+  return rwbench(writepct, start, end);
+}
+
+// rcubench(mode, start, end): look up pids from tick start to
+// tick end, under ptable.lock (mode 0) or RCU (mode 1).  Returns
+// how many lookups this process did.
+int sys_rcubench(void)
+{
+  int mode, start, end;
+
+  if (argint(0, &mode) < 0 || argint(1, &start) < 0 || argint(2, &end) < 0)
+    return -1;
+  return rcubench(mode, start, end);
+}
+
+// plockstat(ps, reset): copy out the statistics of the priority
+// lock behind plock_acquire(), and zero them if reset is set.
+int sys_plockstat(void)
+{
+  struct plockstat *ps;
+  int reset;
+
+  if (argptr(0, (void *)&ps, sizeof(*ps)) < 0 || argint(1, &reset) < 0)
+    return -1;
+  plock_stat(&global_plock, ps, reset);
+  return 0;
+}
+
+// futex(addr, op, val): FUTEX_WAIT sleeps while the word at addr
+// holds val; FUTEX_WAKE wakes up to val processes sleeping on it.
+int sys_futex(void)
+{
+  int addr, op, val;
+
+  if (argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
+
+// mapshared(n): map n zeroed pages that fork() shares with the
+// children instead of copying.  Returns their address.
+int sys_mapshared(void)
+{
+  int n;
+
+  if (argint(0, &n) < 0)
+    return -1;
+  return shm_alloc(myproc(), n);
+}
@@ -0,0 +1,78 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// Random reads over a 32MB array, once with the array backed by
+// 4KB pages and once by 4MB superpages.  Growing the heap one
+// page per sbrk() keeps allocuvm() from ever seeing a whole 4MB
+// chunk, so the first array gets ordinary pages; one big sbrk()
+// from a 4MB boundary gets superpages for the second.
+
+#define ARRAYSZ (32 * 1024 * 1024)
+#define SUPERSZ (4 * 1024 * 1024)
+#define PAGESZ 4096
+#define NACCESS 4000000
+
+static uint seed = 1;
+
+uint rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed;
+}
+
+void run(char *name, char *a)
+{
+  uint64 t0, t1;
+  int ticks0, ticks1;
+  uint i, sum = 0;
+
+  // Touch every page once so both runs start warm.
+  for (i = 0; i < ARRAYSZ; i += PAGESZ)
+    a[i] = i;
+
+  seed = 1;
+  ticks0 = uptime();
+  t0 = rdtsc();
+  for (i = 0; i < NACCESS; i++)
+    sum += a[rnd() % ARRAYSZ];
+  t1 = rdtsc();
+  ticks1 = uptime();
+
+  // No 64-bit division in user space; scale both sides down.
+  printf(1, "%s: %d ticks, %d cycles/access (sum %d)\n",
+         name, ticks1 - ticks0, (uint)((t1 - t0) >> 8) / (NACCESS >> 8), sum);
+}
+
+int main(int argc, char *argv[])
+{
+  char *small, *big;
+  uint brk;
+  int i;
+
+  printf(1, "Starting TLB test over a %d MB array\n", ARRAYSZ / (1024 * 1024));
+
+  small = sbrk(0);
+  for (i = 0; i < ARRAYSZ / PAGESZ; i++)
+  {
+    if (sbrk(PAGESZ) == (char *)-1)
+    {
+      printf(1, "sbrk failed\n");
+      exit();
+    }
+  }
+
+  brk = (uint)sbrk(0);
+  if (sbrk((SUPERSZ - brk % SUPERSZ) % SUPERSZ) == (char *)-1 ||
+      (big = sbrk(ARRAYSZ)) == (char *)-1)
+  {
+    printf(1, "sbrk failed\n");
+    exit();
+  }
+
+  run("4KB pages", small);
+  run("4MB pages", big);
+
+  exit();
+}
@@ -11,7 +11,7 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[]; // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
+struct spinlock tickslock;   // for sleeping until ticks moves
 uint ticks;
 
 void tvinit(void)
@@ -22,7 +22,7 @@ void tvinit(void)
     SETGATE(idt[i], 0, SEG_KCODE << 3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE << 3, vectors[T_SYSCALL], DPL_USER);
 
-  initlock(&tickslock, "time");
+  initlock_type(&tickslock, "time", LOCK_MCS);
 }
 
 void idtinit(void)
@@ -49,11 +49,19 @@ void trap(struct trapframe *tf)
   case T_IRQ0 + IRQ_TIMER:
     if (cpuid() == 0)
     {
-      acquire(&tickslock);
+      // ticks is one aligned word that only cpu0 writes, so
+      // readers need no lock to see a whole value.
       ticks++;
+      // A sleeper checks ticks holding tickslock, so taking it
+      // after the update is enough not to miss one.
+      acquire(&tickslock);
       wakeup(&ticks);
       release(&tickslock);
+      // Page sampling is left to the scheduler (memtick()).
     }
+    // User space holds no RCU references.
+    if ((tf->cs & 3) == DPL_USER)
+      rcu_quiescent();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -78,6 +86,11 @@ void trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    if (swapfault(tf) == 0 || ksmfault(tf) == 0 || lazyfault(tf) == 0)
+      break;
+    // Not a swapped-out, shared or dropped page: fall through.
+
   // PAGEBREAK: 13
   default:
     if (myproc() == 0 || (tf->cs & 3) == 0)
@@ -112,7 +125,14 @@ void trap(struct trapframe *tf)
     {
       balance_load();
     }
-    if (cpuid() % 2 != 0)
+    if (mycpu()->resched)
+    {
+      // Something queued here should run before this process:
+      // one just woken or boosted with a better priority, or
+      // this one has given back a priority it inherited.
+      yield();
+    }
+    else if (cpuid() % 2 != 0)
     {
       // cprintf("CPU %d (Odd): PID %d running (ticks %d)\n", cpuid(), myproc()->pid, myproc()->ticks_consumed);
     }
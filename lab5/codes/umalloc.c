@@ -2,6 +2,7 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "madvise.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
@@ -18,15 +19,18 @@ union header {
 
 typedef union header Header;
 
+#define PGSIZE 4096
+#define RELEASEMIN (4*PGSIZE)  // smallest free() worth a madvise()
+
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// Put block bp on the free list, merging it with its neighbours.
+static void
+insert(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -43,6 +47,24 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  Header *bp;
+  uint lo, hi;
+
+  bp = (Header*)ap - 1;
+  // Whole pages of the block can go back to the kernel: they
+  // hold no header, even once the block has been merged with
+  // its neighbours.  sz stays as it is, so sbrk() is not
+  // affected, and the pages read as zeros when reused.
+  lo = ((uint)ap + PGSIZE-1) & ~(PGSIZE-1);
+  hi = (uint)(bp + bp->s.size) & ~(PGSIZE-1);
+  if(hi > lo && hi - lo >= RELEASEMIN)
+    madvise((void*)lo, hi - lo, MADV_DONTNEED);
+  insert(bp);
+}
+
 static Header*
 morecore(uint nu)
 {
@@ -56,7 +78,7 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  insert(hp);
   return freep;
 }
 
@@ -1,6 +1,12 @@
 #include "types.h"
 struct stat;
 struct rtcdate;
+struct kallocstat;
+struct zramstat;
+struct ksmstat;
+struct memstat;
+struct lockstat;
+struct plockstat;
 
 // system calls
 int fork(void);
@@ -67,3 +73,21 @@ int rwlock_write_release(void);
 int write_page(void*, int);
 int read_page(void*);
 int print_stats(void);
+int kallocstat(struct kallocstat*);
+int slabstat(void);
+int buddystat(void);
+int buddytest(void);
+int setpolicy(int);
+int zramstat(struct zramstat*);
+int ksmstat(struct ksmstat*);
+int memstat(struct memstat*, int);
+int madvise(void*, uint, int);
+int setcolor(int);
+int lockbench(int, uint, uint);
+int lockstat(struct lockstat*, int);
+int lockprof(int);
+int rwbench(int, uint, uint);
+int rcubench(int, uint, uint);
+int plockstat(struct plockstat*, int);
+int futex(volatile uint*, int, uint);
+char* mapshared(int);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "memstat.h"
 
 char buf[8192];
 char name[3];
@@ -1606,6 +1607,88 @@ bsstest(void)
   printf(stdout, "bss test ok\n");
 }
 
+// Push every page of this process out to swap by touching
+// more memory than the machine has, then give it back.  One
+// page per sbrk() keeps superpages out of it.
+void
+swapflood(void)
+{
+  int n, i;
+  char *a;
+
+  n = 240*1024*1024;
+  for(i = 0; i < n; i += 4096){
+    if((a = sbrk(4096)) == (char*)-1){
+      printf(stdout, "swapflood: sbrk failed\n");
+      exit();
+    }
+    *a = i >> 12 | 1;
+  }
+  sbrk(-n);
+}
+
+// write_page() stores through the kernel's map of the page,
+// where the CPU never sets PTE_D.  A page brought back from swap
+// keeps its copy there, so the write must still make the next
+// eviction write the page out again.
+void
+writepagetest(void)
+{
+  int *p;
+
+  printf(stdout, "write_page swap test\n");
+  p = (int*)sbrk(4096);
+  *p = 1;
+  swapflood();
+  if(write_page(p, 0x5a5a) < 0){
+    printf(stdout, "write_page failed\n");
+    exit();
+  }
+  swapflood();
+  if(*p != 0x5a5a){
+    printf(stdout, "write_page swap test failed: %x\n", *p);
+    exit();
+  }
+  sbrk(-4096);
+  printf(stdout, "write_page swap test ok\n");
+}
+
+// A heap grown 8MB at once gets at least one superpage, which
+// must count as resident and which the pager must split to
+// reach its pages, with their contents intact.
+void
+superswaptest(void)
+{
+  static struct memstat ms[NPROC];
+  int i, n, pid;
+  uint *a;
+
+  printf(stdout, "superpage swap test\n");
+  n = 8*1024*1024;
+  if((a = (uint*)sbrk(n)) == (uint*)-1){
+    printf(stdout, "superpage swap test: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < n/4096; i++)
+    a[i*1024] = i;
+  pid = getpid();
+  for(i = memstat(ms, NPROC) - 1; i >= 0 && ms[i].pid != pid; i--)
+    ;
+  if(i < 0 || ms[i].rss < n/4096){
+    printf(stdout, "superpage swap test: not counted as resident\n");
+    exit();
+  }
+  swapflood();
+  for(i = 0; i < n/4096; i++){
+    if(a[i*1024] != i){
+      printf(stdout, "superpage swap test failed at page %d\n", i);
+      exit();
+    }
+  }
+  sbrk(-n);
+  printf(stdout, "superpage swap test ok\n");
+}
+
 // does exec return an error if the arguments
 // are larger than a page? or does it write
 // below the stack and wreck the instructions/data?
@@ -1768,6 +1851,8 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  writepagetest();
+  superswaptest();
   validatetest();
 
   opentest();
@@ -0,0 +1,155 @@
+// User-space synchronization on top of futex().
+//
+// The fast paths are a single xchg, cmpxchg or xadd on shared
+// memory.  futex() is called only to sleep when a process has to
+// wait, and to wake sleepers when there may be some.  The mutex
+// is the three-state one from Drepper's "Futexes Are Tricky".
+
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "futex.h"
+#include "usync.h"
+
+#define WAKEALL 0x7fffffff
+
+void
+umutex_init(struct umutex *m)
+{
+  m->state = 0;
+}
+
+// Take m, marking it contended if it is held: its holder then
+// knows to wake somebody when it lets go.
+void
+umutex_lock(struct umutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+// Returns 1 if m was free and is now held.
+int
+umutex_trylock(struct umutex *m)
+{
+  return cmpxchg(&m->state, 0, 1) == 0;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex(&m->state, FUTEX_WAKE, 1);
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+  c->nwait = 0;
+}
+
+// Release m, sleep until signalled, and take m again.  Like any
+// condition variable, it can return without a signal; callers
+// recheck their condition in a loop.
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  uint seq;
+
+  xadd(&c->nwait, 1);
+  seq = c->seq;
+  umutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  // Others woken with us will want m too.
+  while(xchg(&m->state, 2) != 0)
+    futex(&m->state, FUTEX_WAIT, 2);
+  xadd(&c->nwait, -1);
+}
+
+// The signaller changed the condition holding the mutex, so a
+// waiter has either not yet looked at it or is counted in nwait.
+void
+ucond_signal(struct ucond *c)
+{
+  xadd(&c->seq, 1);
+  if(c->nwait > 0)
+    futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  xadd(&c->seq, 1);
+  if(c->nwait > 0)
+    futex(&c->seq, FUTEX_WAKE, WAKEALL);
+}
+
+void
+usem_init(struct usem *s, uint count)
+{
+  s->count = count;
+  s->nwait = 0;
+}
+
+void
+usem_wait(struct usem *s)
+{
+  uint c;
+
+  for(;;){
+    c = s->count;
+    if(c > 0){
+      if(cmpxchg(&s->count, c, c - 1) == c)
+        return;
+      continue;
+    }
+    // Counted before sleeping, so a post after this sees us.
+    xadd(&s->nwait, 1);
+    futex(&s->count, FUTEX_WAIT, 0);
+    xadd(&s->nwait, -1);
+  }
+}
+
+void
+usem_post(struct usem *s)
+{
+  xadd(&s->count, 1);
+  if(s->nwait > 0)
+    futex(&s->count, FUTEX_WAKE, 1);
+}
+
+void
+ubarrier_init(struct ubarrier *b, uint n)
+{
+  b->n = n;
+  b->count = 0;
+  b->round = 0;
+}
+
+// Wait until all n processes have arrived.  Returns 1 in the
+// last one to arrive, 0 in the others.
+int
+ubarrier_wait(struct ubarrier *b)
+{
+  uint round;
+
+  round = b->round;
+  if(xadd(&b->count, 1) == b->n - 1){
+    b->count = 0;
+    xadd(&b->round, 1);
+    futex(&b->round, FUTEX_WAKE, WAKEALL);
+    return 1;
+  }
+  while(b->round == round)
+    futex(&b->round, FUTEX_WAIT, round);
+  return 0;
+}
@@ -0,0 +1,38 @@
+// User-space mutexes, condition variables, semaphores and
+// barriers (usync.c).  Each is a few words of memory; put them in
+// memory from mapshared() to synchronize a process with its
+// children.  Nobody enters the kernel unless someone must wait.
+
+struct umutex {
+  volatile uint state;    // 0 free, 1 held, 2 held and maybe waited for
+};
+
+struct ucond {
+  volatile uint seq;      // bumped by every signal and broadcast
+  volatile uint nwait;    // processes in ucond_wait()
+};
+
+struct usem {
+  volatile uint count;
+  volatile uint nwait;    // processes in usem_wait() that found count 0
+};
+
+struct ubarrier {
+  uint n;                 // processes that meet at it
+  volatile uint count;    // arrived this round
+  volatile uint round;
+};
+
+void umutex_init(struct umutex*);
+void umutex_lock(struct umutex*);
+int  umutex_trylock(struct umutex*);
+void umutex_unlock(struct umutex*);
+void ucond_init(struct ucond*);
+void ucond_wait(struct ucond*, struct umutex*);
+void ucond_signal(struct ucond*);
+void ucond_broadcast(struct ucond*);
+void usem_init(struct usem*, uint);
+void usem_wait(struct usem*);
+void usem_post(struct usem*);
+void ubarrier_init(struct ubarrier*, uint);
+int  ubarrier_wait(struct ubarrier*);
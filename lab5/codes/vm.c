@@ -6,46 +6,71 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "madvise.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+#define INVLPG_MAX 32  // beyond this many pages, reload %cr3 instead
+
+// Physical addresses of the shared kernel page table pages,
+// so freevm() can refuse to free one.
+static uint kpgtab[8];
+static int nkpgtab;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
 seginit(void)
 {
   struct cpu *c;
+  int apicid;
+
+  // mycpu() needs %gs, which is set up here, so look for this
+  // CPU's local APIC ID instead.
+  apicid = lapicid();
+  for(c = cpus; c < &cpus[ncpu] && c->apicid != apicid; c++)
+    ;
+  if(c == &cpus[ncpu])
+    panic("seginit: unknown apicid");
 
   // Map "logical" addresses to virtual addresses using identity map.
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
   c->gdt[SEG_KCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+  // Per-CPU data: %gs is this CPU's struct cpu.  alltraps
+  // reloads %gs, since user code may change it.
+  c->gdt[SEG_KCPU] = SEG(STA_W, c, sizeof(*c) - 1, 0);
   lgdt(c->gdt, sizeof(c->gdt));
+  c->self = c;
+  c->id = c - cpus;
+  loadgs(SEG_KCPU << 3);
 }
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+// If va is covered by a 4MB superpage, the PDE itself is
+// returned; callers can tell by its PTE_PS bit.
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return pde;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // swapalloc(1) makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)swapalloc(1, -1)) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +82,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -79,6 +104,94 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Physical address of the 4096-byte page that holds va, given
+// the entry walkpgdir() returned for it.
+static uint
+pteaddr(pte_t *pte, const void *va)
+{
+  if(*pte & PTE_PS)
+    return PTE_ADDR(*pte) + ((uint)PGROUNDDOWN((uint)va) & (SUPERPGSIZE-1));
+  return PTE_ADDR(*pte);
+}
+
+// Split the superpage covering va into a page table of
+// 4096-byte PTEs covering the same frames, so that part
+// of it can be unmapped or re-protected.  The frames then
+// belong to the ordinary page allocator and the frame table.
+// Returns 0 if no page table page could be allocated.
+static int
+demote(pde_t *pgdir, uint va)
+{
+  pde_t *pde = &pgdir[PDX(va)];
+  pte_t *pgtab;
+  uint pa, flags;
+  int i;
+
+  if((pgtab = (pte_t*)kalloc()) == 0)
+    return 0;
+  pa = PTE_ADDR(*pde);
+  flags = PTE_FLAGS(*pde) & ~PTE_PS;
+  va = SUPERPGROUNDDOWN(va);
+  for(i = 0; i < NPTENTRIES; i++){
+    pgtab[i] = (pa + i*PGSIZE) | flags;
+    frame_insert(pgdir, va + i*PGSIZE, pa + i*PGSIZE, 0);
+  }
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  frame_super(pgdir, -1);
+  return 1;
+}
+
+// Called by the pager, which cannot evict part of a superpage.
+// Split the first of pgdir's superpages that has not been
+// referenced since the last call, so that its pages age and
+// are evicted like any others, and clear the accessed bit of
+// those that have.  Returns 1 if one was split.
+int
+uvmsplit(pde_t *pgdir)
+{
+  uint i;
+  int current;
+
+  current = rcr3() == V2P(pgdir);
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & (PTE_PS|PTE_U)) != (PTE_PS|PTE_U))
+      continue;
+    if((pgdir[i] & PTE_A) == 0)
+      return demote(pgdir, PGADDR(i, 0, 0));
+    pgdir[i] &= ~PTE_A;
+    // Or the TLB entry keeps the CPU from setting it again.
+    if(current)
+      invlpg((void*)PGADDR(i, 0, 0));
+  }
+  return 0;
+}
+
+// Like mappages(), but uses 4MB PTE_PS entries for every
+// 4MB-aligned stretch of [va, va+size) and 4096-byte PTEs
+// for the rest.  Only used for the kernel's own mappings.
+static int
+mapkern(pde_t *pgdir, char *va, uint size, uint pa, int perm)
+{
+  while(size > 0){
+    if((uint)va % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       size >= SUPERPGSIZE){
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      va += SUPERPGSIZE;
+      pa += SUPERPGSIZE;
+      size -= SUPERPGSIZE;
+    } else {
+      if(mappages(pgdir, va, PGSIZE, pa, perm) < 0)
+        return -1;
+      va += PGSIZE;
+      pa += PGSIZE;
+      size -= PGSIZE;
+    }
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -99,6 +212,12 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
+//
+// Kernel mappings use 4MB PTE_PS pages wherever a whole 4MB-aligned
+// chunk shares one kmap entry, so only the first 4MB (where the
+// read-only text ends and the data starts) needs a page table.
+// They are identical in every page table and marked PTE_G, so with
+// CR4_PGE on (see entry.S) their TLB entries survive switchuvm().
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -115,32 +234,47 @@ static struct kmap {
 };
 
 // Set up kernel part of a page table.
+// The kernel half of every pgdir is a copy of kpgdir's, so all
+// processes share the kernel's second-level page tables.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE)*sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE))*sizeof(pde_t));
+  frame_newpgdir(pgdir);
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  Its kernel page table pages are
+// the ones every later setupkvm() shares; they are never freed.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+  uint i;
+
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkern(kpgdir, k->virt, k->phys_end - k->phys_start,
+               (uint)k->phys_start, k->perm | PTE_G) < 0)
+      panic("kvmalloc: out of memory");
+  for(i = 0; i < NPDENTRIES; i++){
+    if((kpgdir[i] & PTE_P) && !(kpgdir[i] & PTE_PS)){
+      if(nkpgtab == NELEM(kpgtab))
+        panic("kvmalloc: too many page tables");
+      kpgtab[nkpgtab++] = PTE_ADDR(kpgdir[i]);
+    }
+  }
   switchkvm();
 }
 
@@ -186,9 +320,9 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
+  frame_insert(pgdir, 0, V2P(mem), 0);
   memmove(mem, init, sz);
 }
 
@@ -205,7 +339,7 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
       panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
+    pa = pteaddr(pte, addr+i);
     if(sz - i < PGSIZE)
       n = sz - i;
     else
@@ -216,34 +350,57 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   return 0;
 }
 
+// The page colour to back user page va of pgdir with.  Pages
+// next to each other get colours next to each other, so a run
+// of up to NCOLOR of them never shares L2 sets, and each address
+// space starts at a different colour (that of its pgdir page).
+int
+uvmcolor(pde_t *pgdir, uint va)
+{
+  return (V2P(pgdir) + va) / PGSIZE;
+}
+
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Every 4MB-aligned chunk that lies entirely inside the new region is
+// backed by a superpage when one is free, which saves the page table
+// page and lets a single TLB entry cover it.  Until the pager splits
+// it, a superpage is not in the frame table: it cannot be swapped or
+// merged, and it spans every page colour.
 int
 allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > USHM)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % SUPERPGSIZE == 0 && newsz - a >= SUPERPGSIZE &&
+       (pgdir[PDX(a)] & PTE_P) == 0 && (mem = kalloc_super()) != 0){
+      memset(mem, 0, SUPERPGSIZE);
+      pgdir[PDX(a)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+      frame_super(pgdir, 1);
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = swapalloc(1, uvmcolor(pgdir, a));
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
       kfree(mem);
       return 0;
     }
+    frame_insert(pgdir, a, V2P(mem), 0);
   }
   return newsz;
 }
@@ -252,46 +409,102 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
+// If pgdir is the one this CPU is running on, the freed pages are
+// dropped from the TLB one invlpg at a time; past INVLPG_MAX pages a
+// single %cr3 reload is cheaper.  Any other pgdir will be loaded
+// with a fresh %cr3 before it is used again.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   pte_t *pte;
   uint a, pa;
+  int current, nflush;
 
   if(newsz >= oldsz)
     return oldsz;
 
+  current = rcr3() == V2P(pgdir);
+  nflush = 0;
+
   a = PGROUNDUP(newsz);
+  // A superpage straddling newsz is only partly released;
+  // split it first so the rest can be freed page by page.
+  if(a % SUPERPGSIZE && a < oldsz && (pgdir[PDX(a)] & PTE_PS))
+    if(!demote(pgdir, a))
+      return 0;
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    else if(*pte & PTE_PS){
+      kfree_super(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
+      frame_super(pgdir, -1);
+      if(current && ++nflush <= INVLPG_MAX)
+        invlpg((void*)a);
+      a += SUPERPGSIZE - PGSIZE;
+    } else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
-      kfree(v);
+      if(*pte & PTE_COW)
+        ksm_put(pa);
+      else {
+        frame_remove(pgdir, pa);
+        kfree(v);
+      }
+      *pte = 0;
+      if(current && ++nflush <= INVLPG_MAX)
+        invlpg((void*)a);
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      frame_unswap(pgdir);
+      *pte = 0;
+    } else if(*pte & PTE_LAZY)
       *pte = 0;
-    }
   }
+  if(nflush > INVLPG_MAX)
+    lcr3(V2P(pgdir));
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part is shared with kpgdir
+// and every other process, so only user PDEs are torn down.
+// The 4096-byte pages come off the frame table's list for
+// pgdir.  PTEs are scanned only while some may still be in
+// swap or merged, and the scan stops once that many are found.
 void
 freevm(pde_t *pgdir)
 {
-  uint i;
+  pte_t *pgtab;
+  uint i, j, nleft;
+  int k;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
-      char * v = P2V(PTE_ADDR(pgdir[i]));
-      kfree(v);
+  if(pgdir == kpgdir)
+    panic("freevm: kpgdir");
+  nleft = frame_freeall(pgdir);
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(pgdir[i] & PTE_PS){
+      kfree_super(P2V(PTE_ADDR(pgdir[i])));
+    } else if(pgdir[i] & PTE_P){
+      for(k = 0; k < nkpgtab; k++)
+        if(PTE_ADDR(pgdir[i]) == kpgtab[k])
+          panic("freevm: kernel page table");
+      pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+      for(j = 0; nleft > 0 && j < NPTENTRIES; j++){
+        if(pgtab[j] & PTE_SWAP){
+          swapfree(pgtab[j]);
+          nleft--;
+        } else if((pgtab[j] & (PTE_P|PTE_COW)) == (PTE_P|PTE_COW)){
+          ksm_put(PTE_ADDR(pgtab[j]));
+          nleft--;
+        }
+      }
+      kfree((char*)pgtab);
     }
   }
   kfree((char*)pgdir);
@@ -307,6 +520,11 @@ clearpteu(pde_t *pgdir, char *uva)
   pte = walkpgdir(pgdir, uva, 0);
   if(pte == 0)
     panic("clearpteu");
+  if(*pte & PTE_PS){
+    if(!demote(pgdir, (uint)uva))
+      panic("clearpteu: demote");
+    pte = walkpgdir(pgdir, uva, 0);
+  }
   *pte &= ~PTE_U;
 }
 
@@ -316,7 +534,7 @@ pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, *cpte;
   uint pa, i, flags;
   char *mem;
 
@@ -325,17 +543,52 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    // Like every other page, a superpage is copied now.  Give
+    // the child a superpage too if one is free; otherwise copy
+    // it 4096 bytes at a time into pages the pager can reach.
+    if((*pte & PTE_PS) && i % SUPERPGSIZE == 0 &&
+       (mem = kalloc_super()) != 0){
+      memmove(mem, (char*)P2V(PTE_ADDR(*pte)), SUPERPGSIZE);
+      d[PDX(i)] = V2P(mem) | PTE_FLAGS(*pte);
+      frame_super(d, 1);
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    // So is a page still to be zero-filled.
+    if((*pte & (PTE_P|PTE_LAZY)) == PTE_LAZY){
+      if((cpte = walkpgdir(d, (void*)i, 1)) == 0)
+        goto bad;
+      *cpte = *pte;
+      continue;
+    }
+    // A merged page is shared with the child as well.
+    if((*pte & PTE_COW) && ksm_dup(d, PTE_ADDR(*pte)) == 0){
+      if(mappages(d, (void*)i, PGSIZE, PTE_ADDR(*pte), PTE_FLAGS(*pte)) < 0){
+        ksm_put(PTE_ADDR(*pte));
+        goto bad;
+      }
+      continue;
+    }
+    // swapalloc() may push this very page out,
+    // so only look at *pte once it has returned.
+    if((mem = swapalloc(0, uvmcolor(d, i))) == 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    if(*pte & PTE_SWAP){
+      swapread(*pte, mem);
+      flags = PTE_FLAGS(*pte) & ~PTE_SWAP;
+    } else if(*pte & PTE_P){
+      pa = pteaddr(pte, (void *) i);
+      flags = PTE_FLAGS(*pte) & ~PTE_PS;
+      if(flags & PTE_COW)
+        flags = (flags & ~PTE_COW) | PTE_W;
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    } else
+      panic("copyuvm: page not present");
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
       goto bad;
     }
+    frame_insert(d, i, V2P(mem), 0);
   }
   return d;
 
@@ -356,7 +609,22 @@ uva2ka(pde_t *pgdir, char *uva)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  return (char*)P2V(PTE_ADDR(*pte));
+  if(*pte & PTE_COW)
+    return 0;
+  return (char*)P2V(pteaddr(pte, uva));
+}
+
+// Physical address of user address va in pgdir, or 0 if its
+// page is not present.
+uint
+uvmpa(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+    return 0;
+  return pteaddr(pte, (char*)va) | (va & (PGSIZE-1));
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
@@ -371,9 +639,13 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    if(myproc() && myproc()->pgdir == pgdir)
+      uvmtouch(myproc(), va0);
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
+    // The CPU does not see writes through the kernel's mapping.
+    *walkpgdir(pgdir, (char*)va0, 0) |= PTE_D;
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;
@@ -385,6 +657,184 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Give page va of p (the current process) a zeroed frame if it
+// is waiting for one.  Returns -1 if it is not, or if there is
+// no memory.  May sleep.
+int
+lazyin(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_LAZY)) != PTE_LAZY)
+    return -1;
+  // Only p changes its non-present entries, so *pte is
+  // still the same after swapalloc() has evicted pages.
+  if((mem = swapalloc(1, uvmcolor(p->pgdir, va))) == 0)
+    return -1;
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_LAZY) | PTE_P;
+  frame_insert(p->pgdir, va, V2P(mem), 0);
+  p->minflt++;
+  return 0;
+}
+
+// Make page va of p (the current process) present and private
+// before the kernel writes to it: read it back from swap,
+// zero-fill it, or unshare it.  May sleep.
+void
+uvmtouch(struct proc *p, uint va)
+{
+  swapin(p, va);
+  lazyin(p, va);
+  ksm_unshare(p, va);
+}
+
+// Handle a fault on a page madvise(MADV_DONTNEED) dropped.
+// Returns -1 if that is not what it was; see swapfault().
+int
+lazyfault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va = rcr2();
+  pte_t *pte;
+  int r;
+
+  if(p == 0 || va >= p->sz)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_LAZY)) != PTE_LAZY)
+    return -1;
+  if((tf->cs&3) == 0 && (mycpu()->ncli > 0 || (tf->eflags & FL_IF) == 0))
+    return -1;
+  sti();
+  if((r = lazyin(p, PGROUNDDOWN(va))) == 0)
+    seqfault(p, PGROUNDDOWN(va));
+  cli();
+  return r;
+}
+
+// p (the current process) has just faulted page va in.  If va
+// is in a MADV_SEQUENTIAL range, bring in the next SEQRA pages
+// too, and tell the replacement policy that the pages more than
+// SEQRA behind va will not be wanted again.
+void
+seqfault(struct proc *p, uint va)
+{
+  uint lo, hi, a;
+  int i;
+
+  for(i = 0; i < NSEQ; i++)
+    if(va >= p->seq[i].lo && va < p->seq[i].hi)
+      break;
+  if(i == NSEQ)
+    return;
+  lo = p->seq[i].lo;
+  hi = p->seq[i].hi < p->sz ? p->seq[i].hi : p->sz;
+
+  for(a = va + PGSIZE; a < hi && a <= va + SEQRA*PGSIZE; a += PGSIZE)
+    if(swapin(p, a) < 0)
+      lazyin(p, a);
+  a = va - lo > 2*SEQRA*PGSIZE ? va - 2*SEQRA*PGSIZE : lo;
+  for(; a + SEQRA*PGSIZE < va; a += PGSIZE)
+    frame_cold(p->pgdir, a);
+}
+
+// Forget the MADV_SEQUENTIAL ranges overlapping [lo, hi).
+static void
+seqclear(struct proc *p, uint lo, uint hi)
+{
+  int i;
+
+  for(i = 0; i < NSEQ; i++)
+    if(p->seq[i].lo < hi && lo < p->seq[i].hi)
+      p->seq[i].lo = p->seq[i].hi = 0;
+}
+
+// Drop page a of p, leaving a PTE_LAZY entry that zero-fills
+// on the next touch.  Returns 1 if the TLB has to forget a.
+static int
+dontneed(struct proc *p, uint a)
+{
+  pte_t *pte;
+  uint pa;
+
+  pte = walkpgdir(p->pgdir, (char*)a, 0);
+  if(pte == 0 || *pte == 0)
+    return 0;
+  if(*pte & PTE_P){
+    pa = PTE_ADDR(*pte);
+    if(*pte & PTE_COW)
+      ksm_put(pa);
+    else {
+      frame_remove(p->pgdir, pa);
+      kfree(P2V(pa));
+    }
+    *pte = (PTE_FLAGS(*pte) & (PTE_W|PTE_U)) | PTE_LAZY;
+    return 1;
+  }
+  if(*pte & PTE_SWAP){
+    swapfree(*pte);
+    frame_unswap(p->pgdir);
+    *pte = (PTE_FLAGS(*pte) & (PTE_W|PTE_U)) | PTE_LAZY;
+  }
+  return 0;
+}
+
+// madvise() on the pages [va, va+n) of p, the current process.
+// va is page-aligned and the range lies below p->sz.
+int
+uvmadvise(struct proc *p, uint va, uint n, int advice)
+{
+  pte_t *pte;
+  uint a, end;
+  int nflush, flush;
+
+  end = va + PGROUNDUP(n);
+  nflush = 0;
+  switch(advice){
+  case MADV_NORMAL:
+    seqclear(p, va, end);
+    return 0;
+
+  case MADV_SEQUENTIAL:
+    seqclear(p, va, end);
+    p->seq[p->seqnext].lo = va;
+    p->seq[p->seqnext].hi = end;
+    p->seqnext = (p->seqnext + 1) % NSEQ;
+    return 0;
+
+  case MADV_WILLNEED:
+    for(a = va; a < end; a += PGSIZE)
+      if(swapin(p, a) < 0)
+        lazyin(p, a);
+    return 0;
+
+  case MADV_DONTNEED:
+  case MADV_FREE:
+    for(a = va; a < end; a += PGSIZE){
+      // Work on a whole superpage a page at a time.
+      if((p->pgdir[PDX(a)] & PTE_PS) && !demote(p->pgdir, a))
+        return -1;
+      flush = 0;
+      if(advice == MADV_DONTNEED)
+        flush = dontneed(p, a);
+      else if((pte = walkpgdir(p->pgdir, (char*)a, 0)) != 0 &&
+              (*pte & (PTE_P|PTE_COW)) == PTE_P){
+        // swapmark() drops the page if PTE_D is still clear.
+        *pte = (*pte & ~PTE_D) | PTE_LAZY;
+        flush = 1;
+      }
+      if(flush && ++nflush <= INVLPG_MAX)
+        invlpg((void*)a);
+    }
+    if(nflush > INVLPG_MAX)
+      lcr3(V2P(p->pgdir));
+    return 0;
+  }
+  return -1;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
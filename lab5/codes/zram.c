@@ -0,0 +1,435 @@
+// Compressed swap cache, in front of the swap disk.
+//
+// swapwrite() offers each page it is about to write out to
+// zram_store() first.  A page that is one 32-bit word repeated,
+// usually all zeroes, is kept as just that word.  Any other page
+// is run through a small LZ77 coder (LZ4's sequence format) and
+// kept if it shrinks to ZMAXLEN bytes or less.  Only pages that
+// do not compress, or that find the pool full, go to disk; and
+// swapread() asks zram_load() before reading the disk.
+//
+// The pool is at most ZRAMPAGES pages, each cut into ZCHUNK-byte
+// chunks, and a compressed page takes a run of chunks in one of
+// them.  Entries are indexed by swap slot, so the slot states in
+// swap.c order stores, loads and frees for the cache too.  When
+// kalloc() has nothing for a new pool page, the page being stored
+// becomes one: swapout() was about to free it anyway.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "zram.h"
+
+#define ZCHUNK   64                // pool allocation unit, in bytes
+#define NCHUNK   (PGSIZE/ZCHUNK)   // chunks per pool page
+#define ZMAXLEN  (PGSIZE*3/4)      // largest compressed page kept
+#define LZHBITS  12                // log2 of the match finder's table size
+#define LZMIN    4                 // shortest match
+
+enum { ZNONE, ZSAME, ZCOMP };
+
+struct zent {
+  uchar kind;
+  uchar off;          // ZCOMP: first chunk
+  ushort pg;          // ZCOMP: pool page
+  uint val;           // ZSAME: the word; ZCOMP: compressed length
+};
+
+struct zpage {
+  char *mem;          // 0 if this pool entry is unused
+  uint map[NCHUNK/32];  // chunks in use
+  uint nfree;
+};
+
+struct {
+  struct spinlock lock;
+  struct zent *ent;   // one per swap slot
+  uint nent;
+  struct zpage pool[ZRAMPAGES];
+  uint hint;          // pool page allocated from last
+  uchar buf[PGSIZE];  // compressor output
+  ushort hash[1<<LZHBITS];  // 1 + last position with that hash
+  struct zramstat st;
+} zram;
+
+// Set up an entry for each of swap's nslot slots.  Like the
+// frame table, the array comes from the page allocator.
+void
+zraminit(uint nslot)
+{
+  uint sz, a;
+  int order;
+  char *mem;
+
+  initlock(&zram.lock, "zram");
+  zram.st.maxpages = ZRAMPAGES;
+  if(nslot == 0)
+    return;
+  sz = PGROUNDUP(nslot * sizeof(struct zent));
+  for(order = 0; (PGSIZE << order) < sz; order++)
+    ;
+  if((mem = kalloc_order(order)) == 0)
+    panic("zraminit");
+  for(a = sz; a < (PGSIZE << order); a += PGSIZE)
+    kfree(mem + a);
+  memset(mem, 0, sz);
+  zram.ent = (struct zent*)mem;
+  zram.nent = nslot;
+}
+
+static uint
+get32(uchar *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24;
+}
+
+// Append the extra bytes of a length that did not fit its
+// 4-bit field: 255s and a remainder.  Returns the new output
+// position, or -1 if cap would be passed.
+static int
+putlen(uchar *dst, int op, int cap, uint n)
+{
+  for(; n >= 255; n -= 255){
+    if(op >= cap)
+      return -1;
+    dst[op++] = 255;
+  }
+  if(op >= cap)
+    return -1;
+  dst[op++] = n;
+  return op;
+}
+
+// Append one sequence: nlit literal bytes, then a copy of mlen
+// bytes from off bytes back.  The last sequence has no match
+// (mlen == 0) and ends the data.
+static int
+putseq(uchar *dst, int op, int cap, uchar *lit, uint nlit, uint off, uint mlen)
+{
+  uint t;
+
+  t = (nlit < 15 ? nlit : 15) << 4;
+  if(mlen)
+    t |= mlen - LZMIN < 15 ? mlen - LZMIN : 15;
+  if(op >= cap)
+    return -1;
+  dst[op++] = t;
+  if(nlit >= 15 && (op = putlen(dst, op, cap, nlit - 15)) < 0)
+    return -1;
+  if(op + nlit > cap)
+    return -1;
+  memmove(dst + op, lit, nlit);
+  op += nlit;
+  if(mlen == 0)
+    return op;
+  if(op + 2 > cap)
+    return -1;
+  dst[op++] = off;
+  dst[op++] = off >> 8;
+  if(mlen - LZMIN >= 15)
+    op = putlen(dst, op, cap, mlen - LZMIN - 15);
+  return op;
+}
+
+// Compress n bytes at src into dst.  Returns the compressed
+// length, or -1 if it would be more than cap.  Caller holds
+// zram.lock, which guards the match finder's table.
+static int
+lz_compress(uchar *src, uint n, uchar *dst, int cap)
+{
+  uint ip, anchor, ref, len, h, w;
+  int op;
+
+  memset(zram.hash, 0, sizeof(zram.hash));
+  ip = anchor = 0;
+  op = 0;
+  while(ip + LZMIN <= n){
+    w = get32(src + ip);
+    h = (w * 2654435761U) >> (32 - LZHBITS);
+    ref = zram.hash[h];
+    zram.hash[h] = ip + 1;
+    if(ref == 0 || get32(src + ref - 1) != w){
+      ip++;
+      continue;
+    }
+    ref--;
+    for(len = LZMIN; ip + len < n && src[ref + len] == src[ip + len]; len++)
+      ;
+    op = putseq(dst, op, cap, src + anchor, ip - anchor, ip - ref, len);
+    if(op < 0)
+      return -1;
+    ip += len;
+    anchor = ip;
+  }
+  return putseq(dst, op, cap, src + anchor, n - anchor, 0, 0);
+}
+
+// Read the extra bytes of a length, adding them to *len.
+static int
+getlen(uchar *src, uint n, uint *ip, uint *len)
+{
+  uint b;
+
+  do {
+    if(*ip >= n)
+      return -1;
+    b = src[(*ip)++];
+    *len += b;
+  } while(b == 255);
+  return 0;
+}
+
+// Expand n bytes at src, made by lz_compress(), into exactly
+// size bytes at dst.  Returns -1 if the data is corrupt.
+static int
+lz_decompress(uchar *src, uint n, uchar *dst, uint size)
+{
+  uint ip, op, t, nlit, off, mlen;
+
+  ip = op = 0;
+  while(ip < n){
+    t = src[ip++];
+    nlit = t >> 4;
+    if(nlit == 15 && getlen(src, n, &ip, &nlit) < 0)
+      return -1;
+    if(ip + nlit > n || op + nlit > size)
+      return -1;
+    memmove(dst + op, src + ip, nlit);
+    ip += nlit;
+    op += nlit;
+    if(ip == n)
+      break;
+    if(ip + 2 > n)
+      return -1;
+    off = src[ip] | src[ip+1] << 8;
+    ip += 2;
+    mlen = t & 15;
+    if(mlen == 15 && getlen(src, n, &ip, &mlen) < 0)
+      return -1;
+    mlen += LZMIN;
+    if(off == 0 || off > op || op + mlen > size)
+      return -1;
+    // The source may overlap what is being written.
+    for(; mlen > 0; mlen--, op++)
+      dst[op] = dst[op - off];
+  }
+  return op == size ? 0 : -1;
+}
+
+// First run of n free chunks in zp, or -1.
+static int
+runfind(struct zpage *zp, uint n)
+{
+  uint i, run;
+
+  run = 0;
+  for(i = 0; i < NCHUNK; i++){
+    if(zp->map[i/32] & (1 << (i%32)))
+      run = 0;
+    else if(++run == n)
+      return i + 1 - n;
+  }
+  return -1;
+}
+
+static void
+runmark(struct zpage *zp, uint off, uint n, int used)
+{
+  uint i;
+
+  for(i = off; i < off + n; i++){
+    if(used)
+      zp->map[i/32] |= 1 << (i%32);
+    else
+      zp->map[i/32] &= ~(1 << (i%32));
+  }
+  if(used)
+    zp->nfree -= n;
+  else
+    zp->nfree += n;
+}
+
+// Find n free chunks in one pool page, adding a page to the pool
+// if none has room and the pool is below its cap.  If kalloc()
+// has no page for it, victim is used and *took set.  Returns the
+// pool page, with its first free chunk in *off, or -1.
+// Caller holds zram.lock.
+static int
+poolalloc(uint n, char *victim, int *took, uint *off)
+{
+  struct zpage *zp;
+  uint i, pg, empty;
+  int r;
+
+  empty = ZRAMPAGES;
+  for(i = 0; i < ZRAMPAGES; i++){
+    pg = (zram.hint + i) % ZRAMPAGES;
+    zp = &zram.pool[pg];
+    if(zp->mem == 0){
+      if(empty == ZRAMPAGES)
+        empty = pg;
+    } else if(zp->nfree >= n && (r = runfind(zp, n)) >= 0){
+      zram.hint = pg;
+      *off = r;
+      return pg;
+    }
+  }
+  if(empty == ZRAMPAGES)
+    return -1;
+  zp = &zram.pool[empty];
+  if((zp->mem = kalloc()) == 0){
+    zp->mem = victim;
+    *took = 1;
+  }
+  memset(zp->map, 0, sizeof(zp->map));
+  zp->nfree = NCHUNK;
+  zram.st.poolpages++;
+  zram.hint = empty;
+  *off = 0;
+  return empty;
+}
+
+// Forget what e holds, giving back pool pages that empties.
+// Caller holds zram.lock.
+static void
+entfree(struct zent *e)
+{
+  struct zpage *zp;
+  uint len;
+
+  if(e->kind == ZSAME)
+    zram.st.nsame--;
+  else if(e->kind == ZCOMP){
+    zp = &zram.pool[e->pg];
+    len = e->val;
+    runmark(zp, e->off, (len + ZCHUNK-1) / ZCHUNK, 0);
+    zram.st.ncomp--;
+    zram.st.compbytes -= len;
+    if(zp->nfree == NCHUNK){
+      kfree(zp->mem);
+      zp->mem = 0;
+      zram.st.poolpages--;
+    }
+  }
+  e->kind = ZNONE;
+}
+
+// Keep the page at mem for slot, in place of anything the slot
+// had.  Returns -1 if it has to be written to disk instead,
+// 0 if it was kept, and 1 if it was kept and mem itself became
+// a pool page, which the caller must then not free.
+int
+zram_store(uint slot, char *mem)
+{
+  struct zent *e;
+  uint *w = (uint*)mem;
+  uint i, off;
+  int len, pg, took;
+
+  if(slot >= zram.nent)
+    return -1;
+  acquire(&zram.lock);
+  e = &zram.ent[slot];
+  entfree(e);
+  zram.st.stores++;
+
+  for(i = 1; i < PGSIZE/4 && w[i] == w[0]; i++)
+    ;
+  if(i == PGSIZE/4){
+    e->kind = ZSAME;
+    e->val = w[0];
+    zram.st.same++;
+    zram.st.nsame++;
+    release(&zram.lock);
+    return 0;
+  }
+
+  if((len = lz_compress((uchar*)mem, PGSIZE, zram.buf, ZMAXLEN)) < 0){
+    zram.st.rejected++;
+    release(&zram.lock);
+    return -1;
+  }
+  took = 0;
+  if((pg = poolalloc((len + ZCHUNK-1) / ZCHUNK, mem, &took, &off)) < 0){
+    zram.st.full++;
+    release(&zram.lock);
+    return -1;
+  }
+  runmark(&zram.pool[pg], off, (len + ZCHUNK-1) / ZCHUNK, 1);
+  memmove(zram.pool[pg].mem + off*ZCHUNK, zram.buf, len);
+  e->kind = ZCOMP;
+  e->pg = pg;
+  e->off = off;
+  e->val = len;
+  zram.st.compressed++;
+  zram.st.ncomp++;
+  zram.st.compbytes += len;
+  release(&zram.lock);
+  return took;
+}
+
+// Copy slot's page into mem if the cache has it.
+// Returns 0 if it did, -1 if the disk has to be read.
+int
+zram_load(uint slot, char *mem)
+{
+  struct zent *e;
+  uint *w = (uint*)mem;
+  int i, r;
+
+  if(slot >= zram.nent)
+    return -1;
+  acquire(&zram.lock);
+  e = &zram.ent[slot];
+  r = 0;
+  if(e->kind == ZSAME){
+    for(i = 0; i < PGSIZE/4; i++)
+      w[i] = e->val;
+  } else if(e->kind == ZCOMP){
+    if(lz_decompress((uchar*)zram.pool[e->pg].mem + e->off*ZCHUNK, e->val,
+                     (uchar*)mem, PGSIZE) < 0)
+      panic("zram_load");
+  } else
+    r = -1;
+  if(r == 0)
+    zram.st.hits++;
+  else
+    zram.st.misses++;
+  release(&zram.lock);
+  return r;
+}
+
+// slot is being freed or rewritten.
+void
+zram_drop(uint slot)
+{
+  if(slot >= zram.nent)
+    return;
+  acquire(&zram.lock);
+  entfree(&zram.ent[slot]);
+  release(&zram.lock);
+}
+
+void
+zram_stat(struct zramstat *st)
+{
+  acquire(&zram.lock);
+  *st = zram.st;
+  release(&zram.lock);
+}
+
+void
+zramdump(void)
+{
+  struct zramstat *s = &zram.st;
+
+  acquire(&zram.lock);
+  cprintf("zram: %d same-filled, %d compressed into %d bytes, %d/%d pool pages\n",
+          s->nsame, s->ncomp, s->compbytes, s->poolpages, s->maxpages);
+  cprintf("zram: %d stores, %d rejected, %d pool full, %d hits, %d misses\n",
+          s->stores, s->rejected, s->full, s->hits, s->misses);
+  release(&zram.lock);
+}
@@ -0,0 +1,15 @@
+// Compressed swap cache statistics, see zramstat().
+struct zramstat {
+  uint stores;      // pages swapout() offered to the cache
+  uint same;        // of those, stored as one repeated word
+  uint compressed;  // stored compressed
+  uint rejected;    // did not compress well enough; went to disk
+  uint full;        // found the pool full; went to disk
+  uint hits;        // swap-ins served from the cache
+  uint misses;      // swap-ins that had to read the disk
+  uint nsame;       // same-filled pages held right now
+  uint ncomp;       // compressed pages held right now
+  uint compbytes;   // their total compressed size
+  uint poolpages;   // pages the pool is using
+  uint maxpages;    // and may use (ZRAMPAGES)
+};
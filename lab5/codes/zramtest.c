@@ -0,0 +1,100 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "zram.h"
+
+#define PGSIZE 4096
+#define MB (1024 * 1024)
+
+// Page i holds one of four kinds of data, so swap sees a mix of
+// zero pages, same-filled pages, text-like pages that compress
+// well and noise that does not compress at all.
+uint word(int i, int j)
+{
+  uint x;
+
+  switch (i % 4)
+  {
+  case 0:
+    return 0;
+  case 1:
+    return 0x01010101 * (i & 0xff);
+  case 2:
+    return (j % 16 < 12) ? 0x20656874 : i; // "the " and the page number
+  default:
+    x = (uint)i * 2654435761U + (uint)j * 40503;
+    x ^= x >> 13;
+    return x * 1103515245 + 12345;
+  }
+}
+
+void fill(uint *mem, int npages)
+{
+  int i, j;
+
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE / 4; j++)
+      mem[i * (PGSIZE / 4) + j] = word(i, j);
+}
+
+// Returns the number of pages that do not hold what fill() wrote.
+int check(uint *mem, int npages)
+{
+  int i, j, bad;
+
+  bad = 0;
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < PGSIZE / 4; j += 7)
+      if (mem[i * (PGSIZE / 4) + j] != word(i, j))
+      {
+        bad++;
+        break;
+      }
+  return bad;
+}
+
+// Fill more memory than there is (PHYSTOP is 224MB), read it all
+// back twice, and report what the compressed swap cache did.
+int main(int argc, char *argv[])
+{
+  struct zramstat st;
+  int mb, npages, t0, bad, pass;
+  uint *mem;
+
+  mb = 256;
+  if (argc > 1)
+    mb = atoi(argv[1]);
+  npages = mb * (MB / PGSIZE);
+
+  mem = (uint *)sbrk(npages * PGSIZE);
+  if (mem == (uint *)-1)
+  {
+    printf(1, "zramtest: sbrk failed\n");
+    exit();
+  }
+  t0 = uptime();
+  fill(mem, npages);
+  printf(1, "fill: %d MB, %d ticks\n", mb, uptime() - t0);
+  for (pass = 0; pass < 2; pass++)
+  {
+    t0 = uptime();
+    bad = check(mem, npages);
+    printf(1, "check: %d bad pages, %d ticks\n", bad, uptime() - t0);
+  }
+
+  if (zramstat(&st) < 0)
+  {
+    printf(1, "zramtest: zramstat failed\n");
+    exit();
+  }
+  printf(1, "stored %d: %d same-filled, %d compressed, %d to disk (%d incompressible, %d pool full)\n",
+         st.stores, st.same, st.compressed, st.rejected + st.full, st.rejected, st.full);
+  if (st.ncomp > 0)
+    printf(1, "%d compressed pages in %d KB (%d%% of their size), pool %d/%d pages\n",
+           st.ncomp, st.compbytes / 1024,
+           st.compbytes * 100 / (st.ncomp * PGSIZE), st.poolpages, st.maxpages);
+  if (st.hits + st.misses > 0)
+    printf(1, "swap-ins: %d from memory, %d from disk (%d%% hit rate)\n",
+           st.hits, st.misses, st.hits * 100 / (st.hits + st.misses));
+  exit();
+}